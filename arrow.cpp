@@ -1,182 +1,315 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <chrono>
+#include <string_view>
 
 #include "logger.h"
 #include "assembler.h"
 #include "tokenization.h"
+#include "lexer.h"
 #include "parser.h"
+#include "lower.h"
+#include "peephole.h"
+#include "escape.h"
+#include "inliner.h"
+#include "fold.h"
+#include "specialise.h"
+#include "elf.h"
+#include "jit.h"
+#include "bytecode.h"
+#include "interpreter.h"
 
 int main(int argc, char** argv)
 {
-    if (argc <= 1)
+    auto startup = std::chrono::steady_clock::now();
+    const char* input = nullptr;
+    arrow::lex_mode lm = arrow::lex_modes::AUTO;
+    bool timed = false;
+    bool dump_ir = false;
+    bool optimise = true;
+    bool peephole_stats = false;
+    bool allocate_registers = true;
+    bool inline_calls = true;
+    bool inline_report = false;
+    bool specialise = true;
+    bool specialise_report = false;
+    bool fold = true;
+    bool fold_report = false;
+    bool demote = true;
+    bool prune = true;
+    bool prune_report = false;
+    bool merge = true;
+    bool merge_report = false;
+    bool escape_report = false;
+    arrow::operating_system os = arrow::operating_systems::WINDOWS;
+    std::string_view emit; // obj or asm, obj by default where objects can be written
+    bool targeted = false;
+    bool run = false;
+    bool interpret = false;
+    bool dump_bytecode = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if (arg.substr(0, 6) == "--lex=")
+        {
+            lm = arrow::lex_modes::parse(arg.substr(6));
+            if (lm == arrow::lex_modes::AUTO && arg.substr(6) != "auto")
+            {
+                arrow::err("unknown lexer mode '" + std::string(arg.substr(6)) + "', expected auto, scalar, sse2 or avx2");
+                return -1;
+            }
+        }
+        else if (arg.substr(0, 9) == "--target=")
+        {
+            os = arrow::operating_systems::parse(arg.substr(9));
+            targeted = true;
+            if (os == arrow::operating_systems::UNKNOWN)
+            {
+                arrow::err("unknown target '" + std::string(arg.substr(9)) + "', expected windows, linux or mac");
+                return -1;
+            }
+        }
+        else if (arg.substr(0, 7) == "--emit=")
+        {
+            emit = arg.substr(7);
+            if (emit != "asm" && emit != "obj")
+            {
+                arrow::err("unknown output '" + std::string(emit) + "', expected asm or obj");
+                return -1;
+            }
+        }
+        else if (arg == "--jit")
+            run = true;
+        else if (arg == "--interpret")
+            interpret = true;
+        else if (arg == "--bytecode")
+            dump_bytecode = true;
+        else if (arg == "--time")
+            timed = true;
+        else if (arg == "--ir")
+            dump_ir = true;
+        else if (arg == "--no-peephole")
+            optimise = false;
+        else if (arg == "--peephole-stats")
+            peephole_stats = true;
+        else if (arg == "--no-regalloc")
+            allocate_registers = false;
+        else if (arg == "--no-inline")
+            inline_calls = false;
+        else if (arg == "--inline-report")
+            inline_report = true;
+        else if (arg == "--no-specialise")
+            specialise = false;
+        else if (arg == "--specialise-report")
+            specialise_report = true;
+        else if (arg == "--no-fold")
+            fold = false;
+        else if (arg == "--fold-report")
+            fold_report = true;
+        else if (arg == "--no-escape")
+            demote = false;
+        else if (arg == "--escape-report")
+            escape_report = true;
+        else if (arg == "--no-prune")
+            prune = false;
+        else if (arg == "--prune-report")
+            prune_report = true;
+        else if (arg == "--no-merge")
+            merge = false;
+        else if (arg == "--merge-report")
+            merge_report = true;
+        else if (arg.substr(0, 2) == "--")
+        {
+            arrow::err("unknown option '" + std::string(arg) + "'");
+            return -1;
+        }
+        else
+            input = argv[i];
+    }
+    if (input == nullptr)
     {
         arrow::err("no input file");
         return -1;
     }
-    arrow::operating_system os = arrow::operating_systems::WINDOWS;
-    std::ifstream fis = std::ifstream(argv[1]);
-    if (fis.fail())
+    if (run)
     {
-        arrow::err("something happened while trying to open " + std::string(argv[1]));
+        // the program runs here, so it is built for this host
+        if (targeted && os != arrow::operating_systems::LINUX)
+        {
+            arrow::err("--jit only runs programs built for linux");
+            return -1;
+        }
+        os = arrow::operating_systems::LINUX;
+    }
+    if (emit.empty())
+        emit = os == arrow::operating_systems::LINUX ? "obj" : "asm";
+    if (emit == "obj" && os != arrow::operating_systems::LINUX)
+    {
+        arrow::err("object files are only written for linux, use --emit=asm for " + arrow::operating_systems::name(os));
+        return -1;
+    }
+    if (!arrow::lex_modes::supported(lm))
+        arrow::warn("lexer mode " + arrow::lex_modes::name(lm) + " is not supported by this cpu, using " + arrow::lex_modes::name(arrow::lex_modes::resolve(lm)));
+    lm = arrow::lex_modes::resolve(lm);
+    arrow::source src(input);
+    if (!src.good())
+    {
+        arrow::err("something happened while trying to open " + std::string(input));
         return -1;
     }
-    arrow::token* first_token = new arrow::token{ "arrow", arrow::token_types::PROGRAM_START, nullptr, 0 };
-    arrow::token* current = first_token;
-    bool in_comment = false, in_string_literal = false;
-    int line_tracker = 0;
-    for (std::string t; fis.good();)
-    {
-        char c = fis.get();
-        if (c == '"' && (t.length() == 0 || t[t.length() - 1] != '\\'))
-            in_string_literal = !in_string_literal;
-        if (c == '#')
-            in_comment = true;
-        if (c == '\n')
-            line_tracker++;
-        if (in_comment)
+    auto lex_start = std::chrono::steady_clock::now();
+    std::vector<arrow::token> tokens = arrow::lex(src.view(), lm);
+    if (timed)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lex_start).count();
+        arrow::info("lexed " + std::to_string(tokens.size()) + " tokens in " + std::to_string(ms) + " ms using " + arrow::lex_modes::name(lm) +
+            " (" + std::to_string(src.view().length() / 1048576.0 / (ms / 1000.0)) + " MB/s)");
+    }
+    arrow::parser parser = arrow::parser(tokens);
+    auto parse_start = std::chrono::steady_clock::now();
+    while (parser.good())
+    {
+        if (parser.statement() == arrow::evaluation_states::SYNTAX_ERROR)
+            return -1;
+    }
+    if (timed)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
+        arrow::info("parsed " + std::to_string(parser.statement_count()) + " statements in " + std::to_string(ms) + " ms (" +
+            std::to_string((long long) (parser.statement_count() / (ms / 1000.0))) + " statements/sec)");
+    }
+    if (!parser.has_symbol("main"))
+    {
+        arrow::err("no entry point found for application. define a label named 'main'");
+        return -1;
+    }
+    if (inline_calls)
+    {
+        std::vector<std::string> inlined = arrow::inline_labels(parser.result());
+        if (inline_report)
+        {
+            for (std::string& line : inlined)
+                arrow::info(line);
+            arrow::info(std::to_string(inlined.size()) + " calls inlined");
+        }
+    }
+    if (fold)
+    {
+        std::vector<std::string> folded = arrow::fold_constants(parser.result());
+        if (fold_report)
+        {
+            for (std::string& line : folded)
+                arrow::info(line);
+            arrow::info(std::to_string(folded.size()) + " constants folded or stores removed");
+        }
+    }
+    if (specialise)
+    {
+        std::vector<std::string> specialised = arrow::specialise_labels(parser.result());
+        if (specialise_report)
+        {
+            for (std::string& line : specialised)
+                arrow::info(line);
+            arrow::info(std::to_string(specialised.size()) + " calls specialised");
+        }
+    }
+    if (demote)
+    {
+        std::vector<std::string> demoted = arrow::demote_references(parser.result());
+        if (escape_report)
         {
-            if (c == '\n')
-                in_comment = false;
-            continue;
+            for (std::string& line : demoted)
+                arrow::info(line);
+            arrow::info(std::to_string(demoted.size()) + " references moved to the frame");
         }
-        if (c != '\r' && c != '\n' && (c != ' ' || in_string_literal))
-            t += c;
-        if (t.length() == 0)
-            continue;
-        if (int len = arrow::ends_with_punctuator(t) && !in_string_literal)
+    }
+    if (dump_ir)
+        std::cout << parser.result().dump();
+    if (interpret || dump_bytecode)
+    {
+        arrow::bytecode_module program = arrow::bytecode_module();
+        if (!program.compile(parser.result(), "main"))
+            return -1;
+        if (dump_bytecode)
+            std::cout << program.dump();
+        if (interpret)
         {
-            std::string fp = t.substr(0, t.length() - len);
-            if (fp.length() != 0)
+            auto run_start = std::chrono::steady_clock::now();
+            std::int64_t result = 0;
+            if (!arrow::interpret(program, result))
+                return -1;
+            if (timed)
             {
-                if (arrow::is_numeric_literal(fp))
-                    current = current->next = new arrow::token{ fp, arrow::token_types::NUMERIC_LITERAL, nullptr, line_tracker };
-                else if (arrow::is_string_literal(fp))
-                    current = current->next = new arrow::token{ fp, arrow::token_types::STRING_LITERAL, nullptr, line_tracker };
-                else
-                    current = current->next = new arrow::token{ fp, arrow::token_types::IDENTIFIER, nullptr, line_tracker };
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - run_start).count();
+                arrow::info("interpreted main in " + std::to_string(ms) + " ms");
             }
-            current = current->next = new arrow::token{ t.substr(t.length() - len), arrow::token_types::PUNCTUATOR, nullptr, line_tracker };
-            t.erase();
-            continue;
+            return (int) result;
         }
-        if (c != '\n' && c != ' ')
-            continue;
-        if (in_string_literal)
-            continue;
-        if (arrow::is_string_literal(t))
-            current = current->next = new arrow::token{ t, arrow::token_types::STRING_LITERAL, nullptr, line_tracker };
-        else if (arrow::is_type_specifier(t))
-            current = current->next = new arrow::token{ t, arrow::token_types::TYPE_SPECIFIER, nullptr, line_tracker };
-        else if (arrow::is_mnemonic(t))
-            current = current->next = new arrow::token{ t, arrow::token_types::MNEMONIC, nullptr, line_tracker };
-        else if (arrow::is_numeric_literal(t))
-            current = current->next = new arrow::token{ t, arrow::token_types::NUMERIC_LITERAL, nullptr, line_tracker };
-        else
-            current = current->next = new arrow::token{ t, arrow::token_types::IDENTIFIER, nullptr, line_tracker };
-        t.erase();
-    }
-    for (arrow::token* c = first_token; c != nullptr; c = c->next)
-        std::cout << c->content << ", " << arrow::token_types::name(c->type) << std::endl;
-    fis.close();
-    current = first_token->next;
-    arrow::parser parser = arrow::parser(current, os);
-    while (parser.good())
+    }
+    arrow::assembler as = arrow::assembler();
+    arrow::peephole optimiser = arrow::peephole();
+    if (optimise)
+        as.optimise(&optimiser);
+    if (!arrow::lower(parser.result(), as, os, allocate_registers))
+        return -1;
+    if (prune)
     {
-        arrow::evaluation_state ls = parser.label_start();
-        std::cout << "ls: " << arrow::evaluation_states::name(ls) << std::endl;
-        if (ls == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (ls == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state le = parser.label_end();
-        std::cout << "le: " << arrow::evaluation_states::name(le) << std::endl;
-        if (le == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (le == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state ila = parser.il_asm();
-        std::cout << "ila: " << arrow::evaluation_states::name(ila) << std::endl;
-        if (ila == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (ila == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state st = parser.store();
-        std::cout << "st: " << arrow::evaluation_states::name(st) << std::endl;
-        if (st == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (st == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state pa = parser.pass();
-        std::cout << "pa: " << arrow::evaluation_states::name(pa) << std::endl;
-        if (pa == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (pa == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state pu = parser.pull();
-        std::cout << "pu: " << arrow::evaluation_states::name(pu) << std::endl;
-        if (pu == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (pu == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state del = parser.del();
-        std::cout << "del: " << arrow::evaluation_states::name(del) << std::endl;
-        if (del == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (del == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state def = parser.define();
-        std::cout << "def: " << arrow::evaluation_states::name(def) << std::endl;
-        if (def == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (def == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state cp = parser.copy();
-        std::cout << "cp: " << arrow::evaluation_states::name(cp) << std::endl;
-        if (cp == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (cp == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state add = parser.add();
-        std::cout << "add: " << arrow::evaluation_states::name(add) << std::endl;
-        if (add == arrow::evaluation_states::SYNTAX_ERROR)
-            return -1;
-        if (add == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state re = parser.ret();
-        std::cout << "re: " << arrow::evaluation_states::name(re) << std::endl;
-        if (re == arrow::evaluation_states::SYNTAX_ERROR)
+        std::vector<std::string> pruned = as.prune();
+        if (prune_report)
+        {
+            for (std::string& line : pruned)
+                arrow::info(line);
+            arrow::info(std::to_string(pruned.size()) + " unreachable labels, externs and data removed");
+        }
+    }
+    if (merge)
+    {
+        std::size_t saved = 0;
+        std::vector<std::string> merged = as.merge(saved);
+        if (merge_report)
+        {
+            for (std::string& line : merged)
+                arrow::info(line);
+            arrow::info(std::to_string(merged.size()) + " labels merged, " + std::to_string(saved) + " bytes saved");
+        }
+    }
+    if (run)
+    {
+        arrow::elf_object object = arrow::elf_object();
+        if (!as.encode(object))
             return -1;
-        if (re == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state se = parser.set();
-        std::cout << "se: " << arrow::evaluation_states::name(se) << std::endl;
-        if (se == arrow::evaluation_states::SYNTAX_ERROR)
+        arrow::jit_entry entry = arrow::jit(object, as.entry);
+        if (entry == nullptr)
             return -1;
-        if (se == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state rf = parser.reference();
-        std::cout << "rf: " << arrow::evaluation_states::name(rf) << std::endl;
-        if (rf == arrow::evaluation_states::SYNTAX_ERROR)
+        if (peephole_stats)
+            arrow::info(optimiser.report());
+        if (timed)
+        {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup).count();
+            arrow::info("running " + as.entry + ' ' + std::to_string(ms) + " ms after startup");
+        }
+        return entry();
+    }
+    if (emit == "obj")
+    {
+        arrow::elf_object object = arrow::elf_object();
+        if (!as.encode(object))
             return -1;
-        if (rf == arrow::evaluation_states::FOUND)
-            continue;
-        arrow::evaluation_state ca = parser.call();
-        std::cout << "ca: " << arrow::evaluation_states::name(ca) << std::endl;
-        if (ca == arrow::evaluation_states::SYNTAX_ERROR)
+        std::string out = object.write();
+        if (out.empty())
             return -1;
-        if (ca == arrow::evaluation_states::FOUND)
-            continue;
-        break;
+        std::ofstream fos = std::ofstream(std::string(input) + ".o", std::ios::binary);
+        fos.write(out.c_str(), out.length());
+        fos.close();
     }
-    if (!parser.has_symbol("main"))
+    else
     {
-        arrow::err("no entry point found for application. define a label named 'main'");
-        return -1;
+        std::ofstream fos = std::ofstream(std::string(input) + ".asm");
+        std::string out = as.construct();
+        fos.write(out.c_str(), out.length());
+        fos.close();
     }
-    std::ofstream fos = std::ofstream(std::string(argv[1]) + ".asm");
-    std::string out = parser.result();
-    fos.write(out.c_str(), out.length());
-    fos.close();
-    free_tokens(first_token);
+    if (peephole_stats)
+        arrow::info(optimiser.report());
 }
\ No newline at end of file
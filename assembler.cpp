@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
 #include "assembler.h"
-#include "tokenization.h"
+#include "peephole.h"
+#include "elf.h"
+#include "encoder.h"
 
 namespace arrow
 {
@@ -26,7 +32,11 @@ namespace arrow
         "rcx", "rdx", "r8", "r9"
     };
 
-    register_resolvable resolve_register(register_resolvable& identifier, int size)
+    std::vector<std::string> SYSV_CALLING_CONVENTION_REGISTERS = {
+        "rdi", "rsi", "rdx", "rcx", "r8", "r9"
+    };
+
+    register_resolvable resolve_register(const register_resolvable& identifier, int size)
     {
         int lindex = -1;
         if (size == 1)
@@ -39,39 +49,11 @@ namespace arrow
             lindex = 0;
         else
             return "-1";
-        if (identifier.find('a') != std::string::npos)
-            return REGISTER_TABLE[0 + lindex];
-        if (identifier.find('b') != std::string::npos)
-            return REGISTER_TABLE[4 + lindex];
-        if (identifier.find('c') != std::string::npos)
-            return REGISTER_TABLE[8 + lindex];
-        if (identifier.find('d') != std::string::npos)
-            return REGISTER_TABLE[12 + lindex];
-        if (identifier.find("si") != std::string::npos)
-            return REGISTER_TABLE[16 + lindex];
-        if (identifier.find("di") != std::string::npos)
-            return REGISTER_TABLE[20 + lindex];
-        if (identifier.find("bp") != std::string::npos)
-            return REGISTER_TABLE[24 + lindex];
-        if (identifier.find("sp") != std::string::npos)
-            return REGISTER_TABLE[28 + lindex];
-        if (identifier.find("r8") != std::string::npos)
-            return REGISTER_TABLE[32 + lindex];
-        if (identifier.find("r9") != std::string::npos)
-            return REGISTER_TABLE[36 + lindex];
-        if (identifier.find("r10") != std::string::npos)
-            return REGISTER_TABLE[40 + lindex];
-        if (identifier.find("r11") != std::string::npos)
-            return REGISTER_TABLE[44 + lindex];
-        if (identifier.find("r12") != std::string::npos)
-            return REGISTER_TABLE[48 + lindex];
-        if (identifier.find("r13") != std::string::npos)
-            return REGISTER_TABLE[52 + lindex];
-        if (identifier.find("r14") != std::string::npos)
-            return REGISTER_TABLE[56 + lindex];
-        if (identifier.find("r15") != std::string::npos)
-            return REGISTER_TABLE[60 + lindex];
-        return "-1";
+        // by family, as letters alone would take rdi for rdx and rbp for rbx
+        int family = register_family(identifier);
+        if (family == -1)
+            return "-1";
+        return REGISTER_TABLE[family * 4 + lindex];
     }
 
     register_resolvable resolve_register(register_resolvable&& identifier, int size)
@@ -79,13 +61,94 @@ namespace arrow
         return resolve_register(identifier, size);
     }
 
+    // register names packed into an integer, the key REGISTER_TABLE is searched by
+    std::uint32_t register_key(std::string_view name)
+    {
+        std::uint32_t key = 0;
+        for (std::size_t i = 0; i < name.length(); i++)
+            key = key << 8 | (unsigned char) name[i];
+        return key;
+    }
+
+    // position of a register name in REGISTER_TABLE, -1 when it is not one
+    int register_table_index(std::string_view name)
+    {
+        static const std::vector<std::pair<std::uint32_t, int>> INDICES = []
+        {
+            std::vector<std::pair<std::uint32_t, int>> indices;
+            for (std::size_t i = 0; i < sizeof(REGISTER_TABLE) / sizeof(REGISTER_TABLE[0]); i++)
+                indices.push_back({ register_key(REGISTER_TABLE[i]), i });
+            std::sort(indices.begin(), indices.end());
+            return indices;
+        }();
+        if (name.length() < 2 || name.length() > 4)
+            return -1;
+        std::uint32_t key = register_key(name);
+        auto it = std::lower_bound(INDICES.begin(), INDICES.end(), std::make_pair(key, -1));
+        return it != INDICES.end() && it->first == key ? it->second : -1;
+    }
+
+    int register_family(std::string_view name)
+    {
+        int i = register_table_index(name);
+        return i != -1 ? i / 4 : -1;
+    }
+
+    int register_size(std::string_view name)
+    {
+        int i = register_table_index(name);
+        return i != -1 ? 8 >> (i % 4) : 0;
+    }
+
+    std::string trim(const std::string& str)
+    {
+        std::size_t start = str.find_first_not_of(" \t");
+        if (start == std::string::npos)
+            return "";
+        return str.substr(start, str.find_last_not_of(" \t") - start + 1);
+    }
+
+    instruction parse_instruction(const std::string& text)
+    {
+        instruction in = { "", {}, false };
+        std::string line = trim(text);
+        std::size_t space = line.find_first_of(" \t");
+        in.mnemonic = line.substr(0, space);
+        if (space == std::string::npos)
+            return in;
+        std::string operand;
+        int depth = 0;
+        for (char c : line.substr(space + 1))
+        {
+            if (c == '[') depth++;
+            if (c == ']') depth--;
+            if (c == ',' && depth == 0)
+            {
+                in.operands.push_back(trim(operand));
+                operand.clear();
+                continue;
+            }
+            operand += c;
+        }
+        in.operands.push_back(trim(operand));
+        return in;
+    }
+
+    std::string render_instruction(const instruction& in)
+    {
+        if (in.raw)
+            return in.mnemonic;
+        std::string str = in.mnemonic;
+        for (std::size_t i = 0; i < in.operands.size(); i++)
+            str += (i == 0 ? " " : ", ") + in.operands[i];
+        return str;
+    }
+
     subroutine::subroutine(std::string name, subroutine* parent)
     {
         this->name = name;
         this->stackalloc = 0;
         this->offset_mutilator = 0;
-        this->pulls = 0;
-        this->preserve_ret_value = false;
         this->ending = "ret";
         this->parent = parent;
         this->children = nullptr;
@@ -106,25 +169,27 @@ namespace arrow
     {
         if (children == nullptr)
             children = new std::vector<subroutine*>();
-        std::cout << sr << ", " << children << std::endl;
         children->push_back(sr);
         return *this;
     }
 
-    std::string subroutine::construct()
+    std::vector<instruction> subroutine::assemble()
     {
-        std::string str;
+        std::vector<instruction> code;
         if (this->parent == nullptr)
         {
-            str += "\n\tpush rbp\n\tmov rbp, rsp";
+            code.push_back(parse_instruction("push rbp"));
+            code.push_back(parse_instruction("mov rbp, rsp"));
             if (this->stackalloc != 0)
-                str += "\n\tsub rsp, " + std::to_string(this->stackalloc);
+                code.push_back(parse_instruction("sub rsp, " + std::to_string(this->stackalloc)));
         }
-        for (int i = 0; i < (pulls <= 4 ? pulls : 4); i++)
-            str += "\n\tmov [rbp + " + std::to_string((i * 8) + 16) + "], " + X64_CALLING_CONVENTION_REGISTERS[i];
-        str += instructions;
-        if (preserve_ret_value)
-            str += "\n\tpop rax";
+        for (auto& [reg, offset] : saved_registers)
+            code.push_back(parse_instruction("mov qword [rbp + " + std::to_string(offset) + "], " + reg));
+        for (auto& [reg, offset] : homes)
+            code.push_back(parse_instruction("mov qword [rbp + " + std::to_string(offset) + "], " + reg));
+        code.insert(code.end(), instructions.begin(), instructions.end());
+        for (auto& [reg, offset] : saved_registers)
+            code.push_back(parse_instruction("mov " + reg + ", qword [rbp + " + std::to_string(offset) + ']'));
         if ((this->parent != nullptr &&
             this->parent->children != nullptr &&
             this->parent->children->size() > 0 &&
@@ -135,13 +200,21 @@ namespace arrow
                     (this->children != nullptr && this->children->size() == 0))))
         {
             if (this->parent != nullptr && this->parent->stackalloc != 0)
-                str += "\n\tadd rsp, " + std::to_string(this->parent->stackalloc);
+                code.push_back(parse_instruction("add rsp, " + std::to_string(this->parent->stackalloc)));
             else if (this->stackalloc != 0)
-                str += "\n\tadd rsp, " + std::to_string(this->stackalloc);
-            str += "\n\tpop rbp";
+                code.push_back(parse_instruction("add rsp, " + std::to_string(this->stackalloc)));
+            code.push_back(parse_instruction("pop rbp"));
         }
         if (ending.length() != 0)
-            str += "\n\t" + ending;
+            code.push_back(parse_instruction(ending));
+        return code;
+    }
+
+    std::string subroutine::construct()
+    {
+        std::string str;
+        for (instruction& in : assemble())
+            str += "\n\t" + render_instruction(in);
         return str;
     }
 
@@ -153,8 +226,10 @@ namespace arrow
     assembler::assembler(std::string entry)
     {
         this->entry = entry;
+        this->read_only = ".rodata";
         this->write_mode = 0;
         this->ext = std::set<std::string>();
+        this->optimiser = nullptr;
     }
 
     assembler& assembler::enter(std::string& subroutine)
@@ -173,8 +248,7 @@ namespace arrow
         arrow::subroutine*& sr = subroutines[subroutine];
         if (sr == nullptr)
             sr = new arrow::subroutine(subroutine, nullptr);
-        sr->instructions += "\n\t" + instruction;
-        std::cout << "added \"" << instruction << "\" to " << subroutine << std::endl;
+        sr->instructions.push_back(parse_instruction(instruction));
         return *this;
     }
 
@@ -183,12 +257,33 @@ namespace arrow
         return instruct(subroutine, instruction);
     }
 
+    assembler& assembler::raw(std::string& subroutine, std::string text)
+    {
+        arrow::subroutine*& sr = subroutines[subroutine];
+        if (sr == nullptr)
+            sr = new arrow::subroutine(subroutine, nullptr);
+        sr->instructions.push_back({ text, {}, true });
+        return *this;
+    }
+
+    assembler& assembler::optimise(peephole* optimiser)
+    {
+        this->optimiser = optimiser;
+        return *this;
+    }
+
     assembler& assembler::external(std::string identifier)
     {
         ext.insert(identifier);
         return *this;
     }
 
+    assembler& assembler::string(const std::string& label, const std::string& literal)
+    {
+        strings[label] = literal;
+        return *this;
+    }
+
     arrow::subroutine*& assembler::sr(std::string& name, subroutine* parent)
     {
         arrow::subroutine*& sr = subroutines[name];
@@ -205,6 +300,11 @@ namespace arrow
         return sr;
     }
 
+    arrow::subroutine*& assembler::sr(std::string&& name)
+    {
+        return sr(name);
+    }
+
     assembler& assembler::operator<<(std::string& line)
     {
         switch (write_mode)
@@ -219,6 +319,16 @@ namespace arrow
                 bss += '\n' + line;
                 break;
             }
+            case 2:
+            {
+                text += '\n' + line;
+                break;
+            }
+            case 3:
+            {
+                rodata += '\n' + line;
+                break;
+            }
             default:
                 throw std::runtime_error("invalid write mode for assembler");
         }
@@ -235,27 +345,375 @@ namespace arrow
         return mod(*this);
     }
 
+    // everything a line could name: runs of the characters nasm allows in labels,
+    // outside quoted text such as the contents of a string
+    std::vector<std::string> mentioned(const std::string& line)
+    {
+        std::vector<std::string> names;
+        std::string name;
+        char quote = 0;
+        for (char c : line + ' ')
+        {
+            if (quote != 0)
+            {
+                if (c == quote)
+                    quote = 0;
+                continue;
+            }
+            if (std::isalnum((unsigned char) c) || c == '_' || c == '.' || c == '$' || c == '@' || c == '?')
+            {
+                name += c;
+                continue;
+            }
+            if (name.length() != 0)
+                names.push_back(name);
+            name.clear();
+            if (c == '"' || c == '\'' || c == '`')
+                quote = c;
+        }
+        return names;
+    }
+
+    // the lines of a data, bss or routine section, each run of them kept or dropped as
+    // a whole. a run starts at the label it defines, along with the alignment before it.
+    // runs without a label are always kept
+    typedef struct section_run {
+        std::string label;
+        std::vector<std::string> lines;
+    } section_run;
+
+    std::vector<section_run> section_runs(const std::string& section, bool routines)
+    {
+        std::vector<section_run> runs;
+        std::vector<std::string> waiting; // alignment, which goes with the next label
+        for (std::size_t start = 0, end = 0; end != std::string::npos; start = end + 1)
+        {
+            end = section.find('\n', start);
+            std::string line = section.substr(start, end - start);
+            std::string word = trim(line).substr(0, trim(line).find_first_of(" \t"));
+            if (word.empty())
+                continue;
+            std::string label;
+            if (routines && line[0] != '\t' && line[0] != ' ' && word.back() == ':' && word[0] != '.')
+                label = word.substr(0, word.length() - 1);
+            else if (!routines && word != "align" && word != "alignb" && !(word.length() == 2 && word[0] == 'd') && !(word.length() == 4 && word.substr(0, 3) == "res"))
+                label = word.back() == ':' ? word.substr(0, word.length() - 1) : word;
+            if (word == "align" || word == "alignb")
+            {
+                waiting.push_back(line);
+                continue;
+            }
+            if (word == "section")
+                label.clear(); // what follows a section switch is kept with it
+            if (label.length() != 0 || runs.empty() || word == "section")
+            {
+                runs.push_back({ label, waiting });
+                waiting.clear();
+            }
+            runs.back().lines.push_back(line);
+        }
+        return runs;
+    }
+
+    std::vector<std::string> assembler::prune()
+    {
+        std::vector<std::string> report;
+        std::vector<section_run> data_runs = section_runs(data, false);
+        std::vector<section_run> rodata_runs = section_runs(rodata, false);
+        std::vector<section_run> bss_runs = section_runs(bss, false);
+        std::vector<section_run> text_runs = section_runs(text, true);
+        // what each defined name mentions
+        std::map<std::string, std::vector<std::string>> mentions;
+        for (auto& [label, literal] : strings)
+            mentions[label];
+        for (std::vector<section_run>* runs : { &data_runs, &rodata_runs, &bss_runs, &text_runs })
+        {
+            for (section_run& run : *runs)
+            {
+                for (std::string& line : run.lines)
+                {
+                    std::vector<std::string> names = mentioned(line);
+                    mentions[run.label].insert(mentions[run.label].end(), names.begin(), names.end());
+                }
+            }
+        }
+        for (auto& [name, sr] : subroutines)
+        {
+            std::vector<std::string>& names = mentions[name];
+            for (instruction& in : sr->instructions)
+            {
+                for (std::string& found : mentioned(render_instruction(in)))
+                    names.push_back(found);
+            }
+            for (std::string& found : mentioned(sr->ending)) // a tail call
+                names.push_back(found);
+        }
+        // lines belonging to no label are always kept, and so is what they mention
+        std::set<std::string> reached = { "", entry };
+        std::vector<std::string> work = { "", entry };
+        while (!work.empty())
+        {
+            std::string name = work.back();
+            work.pop_back();
+            auto it = mentions.find(name);
+            if (it == mentions.end())
+                continue;
+            for (std::string found : it->second)
+            {
+                // a local label of a routine, reached from outside it
+                while (mentions.count(found) == 0 && found.find('.') != std::string::npos && found.find('.') != 0)
+                    found = found.substr(0, found.rfind('.'));
+                if (reached.insert(found).second)
+                    work.push_back(found);
+            }
+        }
+        for (auto it = subroutines.begin(); it != subroutines.end();)
+        {
+            if (reached.count(it->first) != 0)
+            {
+                it++;
+                continue;
+            }
+            report.push_back("label " + it->first + " removed, " + entry + " never reaches it");
+            delete it->second;
+            it = subroutines.erase(it);
+        }
+        for (auto it = ext.begin(); it != ext.end();)
+        {
+            if (reached.count(*it) != 0)
+            {
+                it++;
+                continue;
+            }
+            report.push_back("extern " + *it + " removed, nothing uses it");
+            it = ext.erase(it);
+        }
+        for (auto it = strings.begin(); it != strings.end();)
+        {
+            if (reached.count(it->first) != 0)
+            {
+                it++;
+                continue;
+            }
+            report.push_back("string " + it->first + " removed, nothing uses it");
+            it = strings.erase(it);
+        }
+        auto rebuild = [&](std::vector<section_run>& runs, const std::string& kind)
+        {
+            std::string section;
+            for (section_run& run : runs)
+            {
+                if (reached.count(run.label) == 0)
+                {
+                    report.push_back(kind + ' ' + run.label + " removed, nothing uses it");
+                    continue;
+                }
+                for (std::string& line : run.lines)
+                    section += '\n' + line;
+            }
+            return section;
+        };
+        data = rebuild(data_runs, "data");
+        rodata = rebuild(rodata_runs, "read-only data");
+        bss = rebuild(bss_runs, "bss");
+        text = rebuild(text_runs, "routine");
+        return report;
+    }
+
+    std::vector<std::string> assembler::merge(std::size_t& saved)
+    {
+        std::vector<std::string> report;
+        // labels of one subroutine that something outside it names directly
+        std::set<std::string> named;
+        for (auto& [name, sr] : subroutines)
+        {
+            for (instruction& in : code(name))
+            {
+                for (std::string& found : mentioned(render_instruction(in)))
+                    named.insert(found);
+            }
+        }
+        for (const std::string* section : { &data, &rodata, &text })
+        {
+            for (std::string& found : mentioned(*section))
+                named.insert(found);
+        }
+        // subroutines by their code, which has to be all they are. one that falls
+        // into the next, has inline asm that may define labels, or has labels used
+        // from outside it stays where it is
+        std::map<std::string, std::size_t> bodies;
+        std::vector<std::vector<std::string>> groups;
+        for (auto& [name, sr] : subroutines)
+        {
+            if (sr->parent != nullptr || sr->children != nullptr || sr->ending.empty())
+                continue;
+            // a dotted name can also be a label of its own, like a specialised copy
+            bool local = false;
+            for (auto it = named.lower_bound(name + '.'); it != named.end() && it->compare(0, name.length() + 1, name + '.') == 0; it++)
+                local = local || subroutines.count(*it) == 0;
+            if (local)
+                continue;
+            std::string body;
+            bool raw = false;
+            for (instruction& in : code(name))
+            {
+                raw = raw || in.raw;
+                body += render_instruction(in) + '\n';
+            }
+            if (raw)
+                continue;
+            auto [it, added] = bodies.emplace(body, groups.size());
+            if (added)
+                groups.emplace_back();
+            groups[it->second].push_back(name);
+        }
+        for (std::vector<std::string>& group : groups)
+        {
+            if (group.size() < 2)
+                continue;
+            // the entry keeps its own code, as it is the one exported
+            std::string kept = std::find(group.begin(), group.end(), entry) != group.end() ? entry : group[0];
+            encoder measure = encoder();
+            for (instruction& in : code(kept))
+                measure.encode(in);
+            for (std::string& name : group)
+            {
+                if (name == kept)
+                    continue;
+                report.push_back("label " + name + " merged into " + kept + ", " + std::to_string(measure.code.size()) + " bytes saved");
+                saved += measure.code.size();
+                aliases[kept].push_back(name);
+                delete subroutines[name];
+                subroutines.erase(name);
+                finished.erase(name);
+            }
+        }
+        return report;
+    }
+
     std::string assembler::construct()
     {
         std::string f;
         for (auto& e : ext)
             f += "extern " + e + '\n';
-        if (data.length() != 0)
-            f += "section .data" + data;
-        if (bss.length() != 0)
+        std::string constants = read_only_data();
+        bool sections = false;
+        for (auto [name, contents] : { std::make_pair(".data", &data), std::make_pair(read_only.c_str(), &constants), std::make_pair(".bss", &bss) })
         {
-            if (data.length() != 0) f += '\n';
-            f += "section .bss" + bss;
+            if (contents->length() == 0)
+                continue;
+            if (sections) f += '\n';
+            f += "section " + std::string(name) + *contents;
+            sections = true;
         }
         if (subroutines.size() == 0)
             return f;
-        if (ext.size() != 0 || data.length() != 0 || bss.length() != 0)
+        if (ext.size() != 0 || sections)
             f += '\n';
         f += "section .text";
         f += "\nglobal " + entry;
         for (std::pair<std::string, arrow::subroutine*> subroutine : subroutines)
-            f += '\n' + subroutine.first + ':' + subroutine.second->construct();
-        return f;
+        {
+            for (std::string& alias : aliases[subroutine.first])
+                f += '\n' + alias + ':';
+            f += '\n' + subroutine.first + ':';
+            for (instruction& in : code(subroutine.first))
+                f += "\n\t" + render_instruction(in);
+        }
+        return f + text;
+    }
+
+    bool assembler::encode(elf_object& object)
+    {
+        for (auto& e : ext)
+            object.external(e);
+        object.global(entry);
+        std::string constants = read_only_data();
+        for (auto [section, contents] : { std::make_pair(elf_sections::DATA, &data), std::make_pair(elf_sections::RODATA, &constants), std::make_pair(elf_sections::BSS, &bss) })
+        {
+            for (std::size_t start = 0, end = 0; end != std::string::npos; start = end + 1)
+            {
+                end = contents->find('\n', start);
+                if (!object.directive(contents->substr(start, end - start), section))
+                    return false;
+            }
+        }
+        for (std::pair<std::string, arrow::subroutine*> subroutine : subroutines)
+        {
+            for (std::string& alias : aliases[subroutine.first])
+            {
+                if (!object.text.label(alias))
+                    return false;
+            }
+            if (!object.text.label(subroutine.first))
+                return false;
+            for (instruction& in : code(subroutine.first))
+            {
+                if (!object.text.encode(in))
+                    return false;
+            }
+        }
+        for (std::size_t start = 0, end = 0; end != std::string::npos; start = end + 1)
+        {
+            end = text.find('\n', start);
+            std::string line = trim(text.substr(start, end - start));
+            // the only section the routines change to is the stack note, which every object has
+            if (line.length() != 0 && line.substr(0, 8) != "section " && !object.text.encode(parse_instruction(line)))
+                return false;
+        }
+        return true;
+    }
+
+    std::string assembler::read_only_data()
+    {
+        // by their contents reversed, so each string sorts right before those it ends
+        std::vector<std::pair<std::string, std::string>> pool;
+        for (auto& [label, literal] : strings)
+        {
+            std::string contents = literal.substr(1, literal.length() - 2);
+            pool.push_back({ std::string(contents.rbegin(), contents.rend()), label });
+        }
+        std::sort(pool.begin(), pool.end());
+        std::string section;
+        // the strings written out in full, and the labels inside each by offset
+        std::vector<std::map<std::size_t, std::string>> hosts;
+        std::vector<std::string> contents;
+        for (std::size_t i = pool.size(); i-- > 0;)
+        {
+            const std::string& reversed = pool[i].first;
+            if (!hosts.empty() && contents.back().compare(0, reversed.length(), reversed) == 0)
+            {
+                hosts.back()[contents.back().length() - reversed.length()] = pool[i].second;
+                continue;
+            }
+            hosts.push_back({ { 0, pool[i].second } });
+            contents.push_back(reversed);
+        }
+        for (std::size_t h = 0; h < hosts.size(); h++)
+        {
+            std::string full(contents[h].rbegin(), contents[h].rend());
+            for (auto it = hosts[h].begin(); it != hosts[h].end(); it++)
+            {
+                auto next = std::next(it);
+                std::string piece = full.substr(it->first, next == hosts[h].end() ? std::string::npos : next->first - it->first);
+                section += '\n' + it->second + " db " + (piece.empty() ? "" : '"' + piece + '"');
+                if (next == hosts[h].end())
+                    section += piece.empty() ? "0" : ", 0";
+            }
+        }
+        return section + rodata;
+    }
+
+    std::vector<instruction>& assembler::code(const std::string& name)
+    {
+        auto it = finished.find(name);
+        if (it != finished.end())
+            return it->second;
+        std::vector<instruction>& code = finished[name];
+        code = subroutines[name]->assemble();
+        if (optimiser != nullptr)
+            optimiser->run(code);
+        return code;
     }
 
     assembler& data(assembler& as)
@@ -264,9 +722,21 @@ namespace arrow
         return as;
     }
 
+    assembler& rodata(assembler& as)
+    {
+        as.write_mode = 3;
+        return as;
+    }
+
     assembler& bss(assembler& as)
     {
         as.write_mode = 1;
         return as;
     }
+
+    assembler& text(assembler& as)
+    {
+        as.write_mode = 2;
+        return as;
+    }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
 #include <set>
@@ -13,26 +14,45 @@ namespace arrow
     typedef std::string register_resolvable;
 
     extern std::vector<std::string> X64_CALLING_CONVENTION_REGISTERS;
+    extern std::vector<std::string> SYSV_CALLING_CONVENTION_REGISTERS;
 
-    register_resolvable resolve_register(register_resolvable& identifier, int size);
+    register_resolvable resolve_register(const register_resolvable& identifier, int size);
     register_resolvable resolve_register(register_resolvable&& identifier, int size);
+    int register_family(std::string_view name); // -1 when name is not a register
+    int register_size(std::string_view name); // 0 when name is not a register
+
+    // one line of a subroutine. raw lines come from inline asm and are written
+    // out exactly as given
+    typedef struct instruction {
+        std::string mnemonic;
+        std::vector<std::string> operands;
+        bool raw;
+    } instruction;
+
+    std::string trim(const std::string& str);
+    instruction parse_instruction(const std::string& text);
+    std::string render_instruction(const instruction& in);
+
+    class peephole;
+    class elf_object;
 
     class subroutine
     {
     public:
         std::string name;
-        std::string instructions;
+        std::vector<instruction> instructions;
         int stackalloc;
         int offset_mutilator;
-        int pulls;
         std::string ending;
         subroutine* parent;
         std::vector<subroutine*>* children;
-        bool preserve_ret_value;
+        std::vector<std::pair<std::string, int>> saved_registers; // callee saved registers in use and the frame slots keeping them
+        std::vector<std::pair<std::string, int>> homes; // argument registers written to frame slots on entry
 
         subroutine(std::string name, subroutine* parent);
         subroutine& alloc_delta(int bs);
         subroutine& add_child(subroutine* sr);
+        std::vector<instruction> assemble();
         std::string construct();
         ~subroutine();
     };
@@ -41,11 +61,20 @@ namespace arrow
     {
     private:
         std::string data;
+        std::string rodata;
         std::string bss;
+        std::string text; // hand written routines placed after the subroutines
         std::set<std::string> ext;
         std::map<std::string, subroutine*> subroutines;
+        std::map<std::string, std::string> strings; // string literals by label, still quoted
+        std::string read_only_data();
+        std::map<std::string, std::vector<std::string>> aliases; // labels merged into the one kept, defined alongside it
+        std::map<std::string, std::vector<instruction>> finished; // code of each subroutine once optimised
+        peephole* optimiser;
+        std::vector<instruction>& code(const std::string& name);
     public:
         std::string entry;
+        std::string read_only; // what the target calls its read-only data section
         unsigned char write_mode;
 
         assembler(std::string entry = "main");
@@ -53,17 +82,26 @@ namespace arrow
         assembler& enter(std::string&& subroutine);
         assembler& instruct(std::string& subroutine, std::string instruction);
         assembler& instruct(std::string&& subroutine, std::string instruction);
+        assembler& raw(std::string& subroutine, std::string text);
+        assembler& optimise(peephole* optimiser);
         assembler& external(std::string identifier);
+        assembler& string(const std::string& label, const std::string& literal); // read-only, sharing bytes with strings it ends
         arrow::subroutine*& sr(std::string& name, subroutine* parent);
         arrow::subroutine*& sr(std::string& name);
+        arrow::subroutine*& sr(std::string&& name);
         assembler& operator<<(std::string& line);
         assembler& operator<<(std::string&& line);
         assembler& operator<<(assembler& (*mod)(assembler& as));
+        std::vector<std::string> prune(); // drops what the entry never reaches, returning a line describing each thing dropped
+        std::vector<std::string> merge(std::size_t& saved); // defines labels with the same code as one, returning a line for each merged and adding the bytes that saves
         std::string construct();
+        bool encode(elf_object& object); // false after reporting what could not be encoded
     };
 
     assembler& data(assembler& as);
+    assembler& rodata(assembler& as);
     assembler& bss(assembler& as);
+    assembler& text(assembler& as);
 }
 
 #endif
\ No newline at end of file
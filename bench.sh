@@ -0,0 +1,15 @@
+#!/bin/bash
+# compares building and running a program natively, in process with --jit and on
+# the interpreter. --time reports how long the interpreter itself ran for
+set -e
+f="$1"
+exe="$(dirname "$f")/$(basename "${f%.ar}")"
+echo "native build:"
+time ./arrow --target=linux "$f"
+time gcc -o "$exe" "$f.o"
+echo "native run:"
+time "$exe" > /dev/null
+echo "jit:"
+time ./arrow --jit "$f" > /dev/null
+echo "interpreter:"
+time ./arrow --interpret --time "$f" | tail -n 1
\ No newline at end of file
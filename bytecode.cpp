@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <map>
+
+#include "bytecode.h"
+#include "logger.h"
+
+namespace arrow
+{
+    namespace bytecode_ops
+    {
+        std::string name(bytecode_op op)
+        {
+            switch (op)
+            {
+                case CONST: return "const";
+                case STRING: return "string";
+                case MOVE: return "move";
+                case LOAD: return "load";
+                case STORE: return "store";
+                case ADD: return "add";
+                case ALLOC: return "alloc";
+                case FREE: return "free";
+                case FRAME_ALLOC: return "frame_alloc";
+                case PARAM: return "param";
+                case CALL: return "call";
+                case CALL_EXTERN: return "call_extern";
+                case RET: return "ret";
+                case END: return "end";
+                case LOAD_I8: return "load_i8";
+                case LOAD_I16: return "load_i16";
+                case LOAD_I32: return "load_i32";
+                case STORE_I8: return "store_i8";
+                case STORE_I16: return "store_i16";
+                case STORE_I32: return "store_i32";
+                case ADD_F32: return "add_f32";
+                case ADD_F64: return "add_f64";
+                case CALL_EXTERN_REAL: return "call_extern_real";
+                case BULK: return "bulk";
+                default: return "UNKNOWN_BYTECODE_OP_" + std::to_string(op);
+            }
+        }
+
+        int operands(bytecode_op op)
+        {
+            switch (op)
+            {
+                case CONST:
+                case ALLOC:
+                case FRAME_ALLOC:
+                case ADD:
+                case ADD_F32:
+                case ADD_F64:
+                case BULK: return 3;
+                case CALL:
+                case CALL_EXTERN: return 4;
+                case CALL_EXTERN_REAL: return 6;
+                case FREE:
+                case RET: return 1;
+                case END: return 0;
+                default: return 2;
+            }
+        }
+    }
+
+    // the load or store op for memory of a value type
+    bytecode_op sized(bytecode_op op, value_type type)
+    {
+        bytecode_op first = op == bytecode_ops::LOAD ? bytecode_ops::LOAD_I8 : bytecode_ops::STORE_I8;
+        switch (value_types::size(type))
+        {
+            case 1: return first;
+            case 2: return first + 1;
+            case 4: return first + 2;
+            default: return op;
+        }
+    }
+
+    // how CALL_EXTERN_REAL passes a value of a type
+    std::uint32_t real_kind(value_type type)
+    {
+        return type == value_types::F32 ? 1 : type == value_types::F64 ? 2 : 0;
+    }
+
+    bytecode_module::bytecode_module()
+    {
+        this->entry = -1;
+    }
+
+    bool bytecode_module::compile(ir_module& module, const std::string& entry)
+    {
+        // double quoted, so nasm would not have treated any escapes either
+        for (std::string& literal : module.literals)
+            literals.push_back(literal.substr(1, literal.length() - 2));
+        std::map<std::string, std::uint32_t> extern_index;
+        for (const std::string& e : module.externs)
+        {
+            extern_index[e] = externs.size();
+            externs.push_back(e);
+        }
+        for (ir_function& fn : module.functions)
+        {
+            std::map<std::uint32_t, std::int64_t> constants;
+            std::vector<std::uint32_t> passed;
+            std::uint32_t arguments = 0;
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op == ir_ops::CONST)
+                        constants[n.dst] = n.imm;
+                    else if (n.op == ir_ops::ARG)
+                        arguments = std::max<std::uint32_t>(arguments, n.imm + 1);
+                }
+            }
+            std::uint32_t slots = fn.values.size();
+            std::uint32_t outgoing = slots + fn.slots.size();
+            std::uint32_t words = outgoing + arguments;
+            bytecode_function& out = functions.emplace_back();
+            out.name = fn.name;
+            std::vector<std::uint32_t>& code = out.code;
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    switch (n.op)
+                    {
+                        case ir_ops::CONST:
+                            code.insert(code.end(), { bytecode_ops::CONST, n.dst, (std::uint32_t) n.imm, (std::uint32_t) ((std::uint64_t) n.imm >> 32) });
+                            break;
+                        case ir_ops::STRING: code.insert(code.end(), { bytecode_ops::STRING, n.dst, (std::uint32_t) n.imm }); break;
+                        case ir_ops::LOAD_SLOT: code.insert(code.end(), { bytecode_ops::MOVE, n.dst, slots + (std::uint32_t) n.imm }); break;
+                        case ir_ops::STORE_SLOT: code.insert(code.end(), { bytecode_ops::MOVE, slots + (std::uint32_t) n.imm, n.a }); break;
+                        case ir_ops::LOAD: code.insert(code.end(), { sized(bytecode_ops::LOAD, n.type), n.dst, n.a }); break;
+                        case ir_ops::STORE: code.insert(code.end(), { sized(bytecode_ops::STORE, n.type), n.a, n.b }); break;
+                        case ir_ops::ADD:
+                        {
+                            bytecode_op op = n.type == value_types::F32 ? bytecode_ops::ADD_F32 : n.type == value_types::F64 ? bytecode_ops::ADD_F64 : bytecode_ops::ADD;
+                            code.insert(code.end(), { op, n.dst, n.a, n.b });
+                            break;
+                        }
+                        case ir_ops::ALLOC:
+                        {
+                            std::uint32_t alignment = n.b != NO_VALUE ? constants[n.b] : 8;
+                            code.insert(code.end(), { bytecode_ops::ALLOC, slots + (std::uint32_t) n.imm, n.a, alignment });
+                            break;
+                        }
+                        case ir_ops::FREE: code.insert(code.end(), { bytecode_ops::FREE, slots + (std::uint32_t) n.imm }); break;
+                        case ir_ops::FRAME_ALLOC:
+                        {
+                            // frames start 64 byte aligned, the most a reference asks for
+                            std::uint32_t size = std::max<std::uint32_t>(1, (constants[n.a] + 7) / 8);
+                            std::uint32_t alignment = std::max<std::uint32_t>(1, (n.b != NO_VALUE ? constants[n.b] : 8) / 8);
+                            std::uint32_t start = (words + alignment - 1) / alignment * alignment;
+                            words = start + size;
+                            code.insert(code.end(), { bytecode_ops::FRAME_ALLOC, slots + (std::uint32_t) n.imm, start, size });
+                            break;
+                        }
+                        case ir_ops::PARAM: code.insert(code.end(), { bytecode_ops::PARAM, n.dst, (std::uint32_t) n.imm }); break;
+                        case ir_ops::ARG:
+                        {
+                            if (passed.size() <= (std::size_t) n.imm)
+                                passed.resize(n.imm + 1, NO_VALUE);
+                            passed[n.imm] = n.a;
+                            code.insert(code.end(), { bytecode_ops::MOVE, outgoing + (std::uint32_t) n.imm, n.a });
+                            break;
+                        }
+                        case ir_ops::CALL:
+                        {
+                            const std::string& name = module.names[n.imm];
+                            int callee = module.find_function(name);
+                            if (callee != -1)
+                            {
+                                code.insert(code.end(), { bytecode_ops::CALL, n.dst, (std::uint32_t) callee, outgoing, n.a });
+                                passed.clear();
+                                break;
+                            }
+                            if (extern_index.count(name) == 0)
+                            {
+                                arrow::err("'" + name + "' is never defined", n.line);
+                                return false;
+                            }
+                            if (n.a > MAX_EXTERN_ARGUMENTS)
+                            {
+                                arrow::err("the interpreter passes at most " + std::to_string(MAX_EXTERN_ARGUMENTS) + " arguments to '" + name + "'", n.line);
+                                return false;
+                            }
+                            // externs take floating point values in vector registers
+                            std::uint32_t kinds = 0;
+                            for (std::size_t i = 0; i < passed.size() && i < n.a; i++)
+                                kinds |= (passed[i] != NO_VALUE ? real_kind(fn.values[passed[i]]) : 0) << (i * 2);
+                            passed.clear();
+                            if (kinds != 0 || value_types::floating(n.type))
+                                code.insert(code.end(), { bytecode_ops::CALL_EXTERN_REAL, n.dst, extern_index[name], outgoing, n.a, kinds, real_kind(n.type) });
+                            else
+                                code.insert(code.end(), { bytecode_ops::CALL_EXTERN, n.dst, extern_index[name], outgoing, n.a });
+                            break;
+                        }
+                        case ir_ops::BULK:
+                        {
+                            code.insert(code.end(), { bytecode_ops::BULK, (std::uint32_t) n.imm, n.type, outgoing });
+                            passed.clear();
+                            break;
+                        }
+                        case ir_ops::RET: code.insert(code.end(), { bytecode_ops::RET, n.a }); break;
+                        default:
+                        {
+                            arrow::err("cannot interpret " + ir_ops::name(n.op) + ", compile natively instead", n.line);
+                            return false;
+                        }
+                    }
+                }
+            }
+            code.push_back(bytecode_ops::END);
+            out.frame = words;
+        }
+        this->entry = module.find_function(entry);
+        if (this->entry == -1)
+        {
+            arrow::err("no entry point '" + entry + "' to run");
+            return false;
+        }
+        return true;
+    }
+
+    std::string bytecode_module::dump()
+    {
+        std::string str;
+        for (std::size_t i = 0; i < externs.size(); i++)
+            str += "extern " + std::to_string(i) + ' ' + externs[i] + '\n';
+        for (std::size_t i = 0; i < literals.size(); i++)
+            str += "literal " + std::to_string(i) + " \"" + literals[i] + "\"\n";
+        for (std::size_t f = 0; f < functions.size(); f++)
+        {
+            bytecode_function& fn = functions[f];
+            str += "function " + std::to_string(f) + ' ' + fn.name + ", frame " + std::to_string(fn.frame) + '\n';
+            for (std::size_t i = 0; i < fn.code.size(); i += 1 + bytecode_ops::operands(fn.code[i]))
+            {
+                str += "  " + std::to_string(i) + ": " + bytecode_ops::name(fn.code[i]);
+                for (int o = 1; o <= bytecode_ops::operands(fn.code[i]); o++)
+                    str += (o == 1 ? " " : ", ") + std::to_string(fn.code[i + o]);
+                str += '\n';
+            }
+        }
+        return str;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef ARROW_BYTECODE_H
+#define ARROW_BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+namespace arrow
+{
+    // ops of the interpreter, one per ir op. operands follow each op as 32-bit
+    // words. registers are indices into the frame of the label, which holds its
+    // values, then its slots, its outgoing arguments and its frame allocated blocks
+    typedef std::uint32_t bytecode_op;
+    namespace bytecode_ops
+    {
+        const bytecode_op CONST = 0x00; // register, low word, high word
+        const bytecode_op STRING = 0x01; // register, literal
+        const bytecode_op MOVE = 0x02; // register, register. slot loads and stores, and arguments
+        const bytecode_op LOAD = 0x03; // register, address register
+        const bytecode_op STORE = 0x04; // address register, register
+        const bytecode_op ADD = 0x05; // register, register, register
+        const bytecode_op ALLOC = 0x06; // slot register, size register, alignment
+        const bytecode_op FREE = 0x07; // slot register
+        const bytecode_op FRAME_ALLOC = 0x08; // slot register, frame word, words
+        const bytecode_op PARAM = 0x09; // register, index
+        const bytecode_op CALL = 0x0A; // register, function, first argument register, arguments
+        const bytecode_op CALL_EXTERN = 0x0B; // register, extern, first argument register, arguments
+        const bytecode_op RET = 0x0C; // register
+        const bytecode_op END = 0x0D;
+        const bytecode_op LOAD_I8 = 0x0E; // loads and stores of narrower memory, sign extended into registers
+        const bytecode_op LOAD_I16 = 0x0F;
+        const bytecode_op LOAD_I32 = 0x10;
+        const bytecode_op STORE_I8 = 0x11;
+        const bytecode_op STORE_I16 = 0x12;
+        const bytecode_op STORE_I32 = 0x13;
+        const bytecode_op ADD_F32 = 0x14; // register, register, register
+        const bytecode_op ADD_F64 = 0x15;
+        const bytecode_op CALL_EXTERN_REAL = 0x16; // as CALL_EXTERN, then two bits per argument and the result: 1 float, 2 double
+        const bytecode_op BULK = 0x17; // bulk op, value type, first argument register
+        const bytecode_op OPS = 0x18;
+
+        std::string name(bytecode_op op);
+        int operands(bytecode_op op); // words following the op
+    }
+
+    // the most arguments a def extern is called with
+    const int MAX_EXTERN_ARGUMENTS = 12;
+
+    typedef struct bytecode_function {
+        std::string name;
+        std::uint32_t frame; // words
+        std::vector<std::uint32_t> code;
+    } bytecode_function;
+
+    class bytecode_module
+    {
+    public:
+        std::vector<bytecode_function> functions;
+        std::vector<std::string> literals; // string contents, as nasm would lay them out
+        std::vector<std::string> externs;
+        int entry;
+
+        bytecode_module();
+        bool compile(ir_module& module, const std::string& entry); // false after reporting what cannot be interpreted
+        std::string dump();
+    };
+}
+
+#endif
\ No newline at end of file
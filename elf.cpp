@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <string_view>
+
+#include "elf.h"
+#include "logger.h"
+
+namespace arrow
+{
+    // the rest of the sections of every object, in order
+    const std::uint16_t RELA_TEXT = 5, SYMTAB = 6, STRTAB = 7, SHSTRTAB = 8, NOTE = 9;
+    const char* SECTION_NAMES[] = { "", ".text", ".data", ".bss", ".rodata", ".rela.text", ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack" };
+    const std::uint16_t SECTIONS = 10;
+
+    const unsigned char STB_LOCAL = 0, STB_GLOBAL = 1;
+    const unsigned char STT_NOTYPE = 0, STT_OBJECT = 1, STT_FUNC = 2, STT_SECTION = 3;
+    const std::uint32_t R_X86_64_64 = 1, R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4;
+
+    typedef struct elf_symbol {
+        std::string name;
+        unsigned char info;
+        std::uint16_t section;
+        std::uint64_t value;
+    } elf_symbol;
+
+    template <typename T>
+    void put(std::string& out, T value)
+    {
+        for (std::size_t i = 0; i < sizeof(T); i++)
+            out += (char) ((std::uint64_t) value >> (i * 8) & 0xFF);
+    }
+
+    // appends contents at the next multiple of alignment, returning where they start
+    std::uint64_t place(std::string& out, const std::string& contents, std::uint64_t alignment)
+    {
+        while (out.length() % alignment != 0)
+            out += '\0';
+        std::uint64_t offset = out.length();
+        out += contents;
+        return offset;
+    }
+
+    void section_header(std::string& out, std::uint32_t name, std::uint32_t type, std::uint64_t flags, std::uint64_t offset,
+        std::uint64_t size, std::uint32_t link, std::uint32_t info, std::uint64_t alignment, std::uint64_t entry_size)
+    {
+        put(out, name);
+        put(out, type);
+        put(out, flags);
+        put<std::uint64_t>(out, 0); // address
+        put(out, offset);
+        put(out, size);
+        put(out, link);
+        put(out, info);
+        put(out, alignment);
+        put(out, entry_size);
+    }
+
+    // bytes per item of db/dw/dd/dq when prefix is "d", or of resb/resw/resd/resq
+    // when it is "res". 0 for any other word
+    int directive_unit(std::string_view word, std::string_view prefix)
+    {
+        if (word.length() != prefix.length() + 1 || word.substr(0, prefix.length()) != prefix)
+            return 0;
+        switch (word.back())
+        {
+            case 'b': return 1;
+            case 'w': return 2;
+            case 'd': return 4;
+            case 'q': return 8;
+            default: return 0;
+        }
+    }
+
+    bool parse_count(const std::string& text, std::uint64_t& n)
+    {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        n = std::stoull(text);
+        return true;
+    }
+
+    // the bytes of one item of a data directive. as in nasm, only backquoted
+    // strings have escapes
+    bool item_bytes(const std::string& item, int unit, std::vector<unsigned char>& out)
+    {
+        char quote = item.empty() ? 0 : item[0];
+        if (quote == '"' || quote == '\'' || quote == '`')
+        {
+            if (item.length() < 2 || item.back() != quote || unit != 1)
+                return false;
+            for (std::size_t i = 1; i < item.length() - 1; i++)
+            {
+                char c = item[i];
+                if (quote == '`' && c == '\\' && i + 1 < item.length() - 1)
+                {
+                    switch (item[++i])
+                    {
+                        case 'n': c = '\n'; break;
+                        case 't': c = '\t'; break;
+                        case 'r': c = '\r'; break;
+                        case '0': c = '\0'; break;
+                        default: c = item[i]; break;
+                    }
+                }
+                out.push_back(c);
+            }
+            return true;
+        }
+        bool negative = !item.empty() && item[0] == '-';
+        std::uint64_t n = 0;
+        if (!parse_count(negative ? item.substr(1) : item, n))
+            return false;
+        if (negative)
+            n = -n;
+        for (int i = 0; i < unit; i++)
+            out.push_back(n >> (i * 8) & 0xFF);
+        return true;
+    }
+
+    elf_object::elf_object()
+    {
+        this->bss = 0;
+        this->data_alignment = 8;
+        this->rodata_alignment = 1;
+        this->bss_alignment = 8;
+    }
+
+    void elf_object::global(const std::string& name)
+    {
+        globals.insert(name);
+    }
+
+    void elf_object::external(const std::string& name)
+    {
+        externals.insert(name);
+    }
+
+    bool elf_object::directive(const std::string& line, std::uint16_t section)
+    {
+        bool uninitialised = section == elf_sections::BSS;
+        std::vector<unsigned char>& bytes = section == elf_sections::RODATA ? rodata : data;
+        std::uint64_t& alignment = section == elf_sections::RODATA ? rodata_alignment : uninitialised ? bss_alignment : data_alignment;
+        std::string rest = trim(line);
+        if (rest.empty())
+            return true;
+        std::size_t space = rest.find_first_of(" \t");
+        std::string word = rest.substr(0, space);
+        std::string label;
+        if (word != "align" && word != "alignb" && directive_unit(word, "d") == 0 && directive_unit(word, "res") == 0)
+        {
+            label = word.back() == ':' ? word.substr(0, word.length() - 1) : word;
+            rest = space == std::string::npos ? "" : trim(rest.substr(space));
+            space = rest.find_first_of(" \t");
+            word = rest.substr(0, space);
+        }
+        std::string arguments = space == std::string::npos ? "" : trim(rest.substr(space));
+        std::uint64_t offset = uninitialised ? bss : bytes.size();
+        if (label.length() != 0 && !symbols.emplace(label, std::make_pair(section, offset)).second)
+        {
+            arrow::err("label '" + label + "' is defined twice");
+            return false;
+        }
+        std::uint64_t n = 0;
+        if (word.empty())
+            return true;
+        if ((word == "align" || word == "alignb") && parse_count(arguments, n) && n != 0 && (n & (n - 1)) == 0)
+        {
+            std::uint64_t padding = (n - offset % n) % n;
+            if (uninitialised)
+                bss += padding;
+            else
+                bytes.insert(bytes.end(), padding, 0);
+            alignment = std::max(alignment, n);
+            return true;
+        }
+        if (directive_unit(word, "res") != 0 && parse_count(arguments, n))
+        {
+            if (uninitialised)
+                bss += n * directive_unit(word, "res");
+            else
+                bytes.insert(bytes.end(), n * directive_unit(word, "res"), 0);
+            return true;
+        }
+        if (directive_unit(word, "d") != 0 && !uninitialised)
+        {
+            std::string item;
+            char quote = 0;
+            for (char c : arguments + ',')
+            {
+                if (quote == 0 && c == ',')
+                {
+                    if (!item_bytes(trim(item), directive_unit(word, "d"), bytes))
+                        break;
+                    item.clear();
+                    continue;
+                }
+                if (c == quote)
+                    quote = 0;
+                else if (quote == 0 && (c == '"' || c == '\'' || c == '`'))
+                    quote = c;
+                item += c;
+            }
+            if (item.empty())
+                return true;
+        }
+        arrow::err("cannot encode '" + trim(line) + "', use --emit=asm and an external assembler instead");
+        return false;
+    }
+
+    std::string elf_object::write()
+    {
+        text.resolve();
+        std::map<std::string, std::pair<int, std::uint64_t>> defined = symbols;
+        for (auto& [name, offset] : text.labels)
+        {
+            if (!defined.emplace(name, std::make_pair(elf_sections::TEXT, offset)).second)
+            {
+                arrow::err("label '" + name + "' is defined twice");
+                return "";
+            }
+        }
+        // locals come first, starting with a symbol per section for tools to use
+        std::vector<elf_symbol> table = { { "", 0, 0, 0 } };
+        for (std::uint16_t s = elf_sections::TEXT; s <= elf_sections::RODATA; s++)
+            table.push_back({ "", STB_LOCAL << 4 | STT_SECTION, s, 0 });
+        for (auto& [name, place] : defined)
+        {
+            if (globals.count(name) == 0)
+                table.push_back({ name, STB_LOCAL << 4 | STT_NOTYPE, (std::uint16_t) place.first, place.second });
+        }
+        std::uint32_t first_global = table.size();
+        for (const std::string& name : globals)
+        {
+            auto it = defined.find(name);
+            if (it == defined.end())
+            {
+                arrow::err("global '" + name + "' is never defined");
+                return "";
+            }
+            unsigned char type = it->second.first == elf_sections::TEXT ? STT_FUNC : STT_OBJECT;
+            table.push_back({ name, (unsigned char) (STB_GLOBAL << 4 | type), (std::uint16_t) it->second.first, it->second.second });
+        }
+        for (const std::string& name : externals)
+        {
+            if (defined.count(name) == 0)
+                table.push_back({ name, STB_GLOBAL << 4 | STT_NOTYPE, 0, 0 });
+        }
+        std::map<std::string, std::uint32_t> indices;
+        std::string symtab, strtab(1, '\0');
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            std::uint32_t name = 0;
+            if (table[i].name.length() != 0)
+            {
+                indices[table[i].name] = i;
+                name = strtab.length();
+                strtab += table[i].name + '\0';
+            }
+            put(symtab, name);
+            put(symtab, table[i].info);
+            put<unsigned char>(symtab, 0);
+            put(symtab, table[i].section);
+            put(symtab, table[i].value);
+            put<std::uint64_t>(symtab, 0); // size
+        }
+        std::string relocations;
+        for (fixup& f : text.fixups)
+        {
+            auto it = indices.find(f.symbol);
+            if (it == indices.end())
+            {
+                arrow::err("'" + f.symbol + "' is never defined");
+                return "";
+            }
+            std::uint32_t type = f.kind == fixup_kinds::RELATIVE ? R_X86_64_PC32 : f.kind == fixup_kinds::BRANCH ? R_X86_64_PLT32 : R_X86_64_64;
+            put<std::uint64_t>(relocations, f.offset);
+            put(relocations, (std::uint64_t) it->second << 32 | type);
+            put<std::int64_t>(relocations, f.addend);
+        }
+        std::string shstrtab;
+        std::uint32_t names[SECTIONS];
+        for (std::uint16_t s = 0; s < SECTIONS; s++)
+        {
+            names[s] = shstrtab.length();
+            shstrtab += std::string(SECTION_NAMES[s]) + '\0';
+        }
+        std::string out(64, '\0');
+        std::uint64_t text_offset = place(out, std::string(text.code.begin(), text.code.end()), 16);
+        std::uint64_t data_offset = place(out, std::string(data.begin(), data.end()), data_alignment);
+        std::uint64_t rodata_offset = place(out, std::string(rodata.begin(), rodata.end()), rodata_alignment);
+        std::uint64_t rela_offset = place(out, relocations, 8);
+        std::uint64_t symtab_offset = place(out, symtab, 8);
+        std::uint64_t strtab_offset = place(out, strtab, 1);
+        std::uint64_t shstrtab_offset = place(out, shstrtab, 1);
+        std::uint64_t headers = place(out, "", 8);
+        out += std::string(64, '\0'); // the null section
+        section_header(out, names[elf_sections::TEXT], 1, 0x6, text_offset, text.code.size(), 0, 0, 16, 0); // progbits, alloc and exec
+        section_header(out, names[elf_sections::DATA], 1, 0x3, data_offset, data.size(), 0, 0, data_alignment, 0); // progbits, write and alloc
+        section_header(out, names[elf_sections::BSS], 8, 0x3, rela_offset, bss, 0, 0, bss_alignment, 0); // nobits
+        section_header(out, names[elf_sections::RODATA], 1, 0x2, rodata_offset, rodata.size(), 0, 0, rodata_alignment, 0); // progbits, alloc only
+        section_header(out, names[RELA_TEXT], 4, 0x40, rela_offset, relocations.length(), SYMTAB, elf_sections::TEXT, 8, 24); // info link
+        section_header(out, names[SYMTAB], 2, 0, symtab_offset, symtab.length(), STRTAB, first_global, 8, 24);
+        section_header(out, names[STRTAB], 3, 0, strtab_offset, strtab.length(), 0, 0, 1, 0);
+        section_header(out, names[SHSTRTAB], 3, 0, shstrtab_offset, shstrtab.length(), 0, 0, 1, 0);
+        section_header(out, names[NOTE], 1, 0, headers, 0, 0, 0, 1, 0); // no executable stack
+        std::string header = "\x7f" "ELF";
+        header += "\x02\x01\x01"; // 64-bit, little endian, version 1
+        header += std::string(9, '\0');
+        put<std::uint16_t>(header, 1); // relocatable
+        put<std::uint16_t>(header, 62); // x86-64
+        put<std::uint32_t>(header, 1);
+        put<std::uint64_t>(header, 0); // entry
+        put<std::uint64_t>(header, 0); // program headers
+        put<std::uint64_t>(header, headers);
+        put<std::uint32_t>(header, 0); // flags
+        put<std::uint16_t>(header, 64);
+        put<std::uint16_t>(header, 0);
+        put<std::uint16_t>(header, 0);
+        put<std::uint16_t>(header, 64);
+        put<std::uint16_t>(header, SECTIONS);
+        put<std::uint16_t>(header, SHSTRTAB);
+        out.replace(0, header.length(), header);
+        return out;
+    }
+}
\ No newline at end of file
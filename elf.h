@@ -0,0 +1,48 @@
+#ifndef ARROW_ELF_H
+#define ARROW_ELF_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "encoder.h"
+
+namespace arrow
+{
+    // section indices of the sections labels can be in
+    namespace elf_sections
+    {
+        const std::uint16_t TEXT = 1;
+        const std::uint16_t DATA = 2;
+        const std::uint16_t BSS = 3;
+        const std::uint16_t RODATA = 4;
+    }
+
+    // a relocatable x86-64 elf object built in memory, so programs for linux link
+    // without an external assembler. text goes through the encoder, data, bss
+    // and read-only data are filled from the same nasm directives the assembler collects
+    class elf_object
+    {
+    public:
+        encoder text;
+        std::vector<unsigned char> data;
+        std::vector<unsigned char> rodata;
+        std::uint64_t bss; // size, bss has no contents
+        std::uint64_t data_alignment;
+        std::uint64_t rodata_alignment;
+        std::uint64_t bss_alignment;
+        std::map<std::string, std::pair<int, std::uint64_t>> symbols; // data, read-only data and bss labels: section and offset
+        std::set<std::string> globals;
+        std::set<std::string> externals;
+
+        elf_object();
+        void global(const std::string& name);
+        void external(const std::string& name);
+        bool directive(const std::string& line, std::uint16_t section); // one line of data, read-only data or bss
+        std::string write(); // the object file, empty after reporting an error
+    };
+}
+
+#endif
\ No newline at end of file
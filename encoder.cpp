@@ -0,0 +1,752 @@
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+
+#include "encoder.h"
+#include "logger.h"
+
+namespace arrow
+{
+    // hardware numbers of the register families, which follow the register table
+    const int HARDWARE_REGISTERS[] = { 0, 3, 1, 2, 6, 7, 5, 4, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+    typedef unsigned int operand_kind;
+    namespace operand_kinds
+    {
+        const operand_kind NONE = 0x00;
+        const operand_kind REGISTER = 0x01;
+        const operand_kind IMMEDIATE = 0x02;
+        const operand_kind MEMORY = 0x03;
+        const operand_kind SYMBOL = 0x04;
+        const operand_kind VECTOR = 0x05; // xmm, ymm or zmm register
+    }
+
+    typedef struct operand {
+        operand_kind kind;
+        int size; // in bytes, 0 when memory does not say
+        int reg; // hardware number
+        std::int64_t value; // immediate, or displacement of memory
+        int base; // -1 when absent
+        int index;
+        int scale;
+        std::string symbol; // branch target, or what rip relative memory is measured to
+    } operand;
+
+    // ALU operations sharing the 00-3f opcodes and the 80-83 group, by extension
+    const std::pair<const char*, int> ARITHMETIC[] = {
+        { "add", 0 }, { "or", 1 }, { "adc", 2 }, { "sbb", 3 }, { "and", 4 }, { "sub", 5 }, { "xor", 6 }, { "cmp", 7 }
+    };
+
+    const std::pair<const char*, int> SHIFTS[] = {
+        { "rol", 0 }, { "ror", 1 }, { "shl", 4 }, { "sal", 4 }, { "shr", 5 }, { "sar", 7 }
+    };
+
+    // one operand instructions of the f6/f7 and fe/ff groups: opcode and extension
+    const std::pair<const char*, std::pair<int, int>> UNARY[] = {
+        { "inc", { 0xFE, 0 } }, { "dec", { 0xFE, 1 } }, { "not", { 0xF6, 2 } }, { "neg", { 0xF6, 3 } },
+        { "mul", { 0xF6, 4 } }, { "div", { 0xF6, 6 } }, { "idiv", { 0xF6, 7 } }
+    };
+
+    const std::pair<const char*, std::vector<unsigned char>> BARE[] = {
+        { "ret", { 0xC3 } }, { "syscall", { 0x0F, 0x05 } }, { "leave", { 0xC9 } }, { "nop", { 0x90 } },
+        { "cqo", { 0x48, 0x99 } }, { "cdq", { 0x99 } }, { "cld", { 0xFC } }, { "int3", { 0xCC } }, { "ud2", { 0x0F, 0x0B } },
+        { "stosb", { 0xAA } }, { "stosd", { 0xAB } }, { "stosq", { 0x48, 0xAB } },
+        { "movsb", { 0xA4 } }, { "movsd", { 0xA5 } }, { "movsq", { 0x48, 0xA5 } },
+        { "cpuid", { 0x0F, 0xA2 } }, { "xgetbv", { 0x0F, 0x01, 0xD0 } }, { "vzeroupper", { 0xC5, 0xF8, 0x77 } }
+    };
+
+    // scalar sse arithmetic between a vector register and a vector register or memory:
+    // the opcode after the mandatory prefix, which is f3 for single and f2 for double
+    const std::pair<const char*, int> SCALAR[] = {
+        { "add", 0x58 }, { "mul", 0x59 }, { "sub", 0x5C }, { "min", 0x5D }, { "div", 0x5E }, { "max", 0x5F }, { "sqrt", 0x51 }
+    };
+
+    // packed arithmetic between vector registers or memory. sse takes two operands,
+    // its avx forms a separate first source, and wide marks the evex forms over qwords
+    typedef struct packed_form {
+        const char* name;
+        unsigned char prefix; // mandatory prefix, 0 for none
+        unsigned char map; // 1 for 0f, 2 for 0f 38
+        unsigned char opcode;
+        bool wide;
+    } packed_form;
+
+    const packed_form PACKED[] = {
+        { "paddb", 0x66, 1, 0xFC, false }, { "paddw", 0x66, 1, 0xFD, false }, { "paddd", 0x66, 1, 0xFE, false }, { "paddq", 0x66, 1, 0xD4, true },
+        { "pmullw", 0x66, 1, 0xD5, false }, { "pmulld", 0x66, 2, 0x40, false }, { "punpcklqdq", 0x66, 1, 0x6C, true },
+        { "addps", 0x00, 1, 0x58, false }, { "addpd", 0x66, 1, 0x58, true }, { "mulps", 0x00, 1, 0x59, false }, { "mulpd", 0x66, 1, 0x59, true }
+    };
+
+    // condition code of a jcc, cmovcc or setcc suffix, -1 for anything else
+    int condition(std::string_view suffix)
+    {
+        static const std::pair<const char*, int> CONDITIONS[] = {
+            { "o", 0 }, { "no", 1 }, { "b", 2 }, { "c", 2 }, { "nae", 2 }, { "ae", 3 }, { "nb", 3 }, { "nc", 3 },
+            { "e", 4 }, { "z", 4 }, { "ne", 5 }, { "nz", 5 }, { "be", 6 }, { "na", 6 }, { "a", 7 }, { "nbe", 7 },
+            { "s", 8 }, { "ns", 9 }, { "p", 10 }, { "pe", 10 }, { "np", 11 }, { "po", 11 },
+            { "l", 12 }, { "nge", 12 }, { "ge", 13 }, { "nl", 13 }, { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 }
+        };
+        for (auto& [name, cc] : CONDITIONS)
+        {
+            if (suffix == name)
+                return cc;
+        }
+        return -1;
+    }
+
+    // decimal or 0x prefixed hexadecimal, optionally negative
+    bool parse_number(std::string_view text, std::int64_t& n)
+    {
+        bool negative = !text.empty() && text[0] == '-';
+        if (negative)
+            text.remove_prefix(1);
+        int base = 10;
+        if (text.length() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+        {
+            base = 16;
+            text.remove_prefix(2);
+        }
+        std::uint64_t u = 0;
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.length(), u, base);
+        if (text.empty() || ec != std::errc() || end != text.data() + text.length())
+            return false;
+        n = negative ? -(std::int64_t) u : (std::int64_t) u;
+        return true;
+    }
+
+    bool fits8(std::int64_t n)
+    {
+        return n >= INT8_MIN && n <= INT8_MAX;
+    }
+
+    bool fits32(std::int64_t n)
+    {
+        return n >= INT32_MIN && n <= INT32_MAX;
+    }
+
+    // whether n can be written as an immediate of an operation of the given size,
+    // which for 64-bit operations is a sign extended 32-bit one
+    bool fits(std::int64_t n, int size)
+    {
+        if (size == 8)
+            return fits32(n);
+        return n >= -(1LL << (size * 8 - 1)) && n <= (1LL << (size * 8)) - 1;
+    }
+
+    bool is_symbol(std::string_view text)
+    {
+        if (text.empty() || (text[0] >= '0' && text[0] <= '9'))
+            return false;
+        for (char c : text)
+        {
+            if (!std::isalnum((unsigned char) c) && c != '_' && c != '.' && c != '$' && c != '@')
+                return false;
+        }
+        return true;
+    }
+
+    // one term of a memory operand: a register, register * scale, a number or a symbol
+    bool memory_term(std::string term, bool negative, operand& op)
+    {
+        term = trim(term);
+        std::size_t star = term.find('*');
+        if (star != std::string::npos)
+        {
+            std::string left = trim(term.substr(0, star)), right = trim(term.substr(star + 1));
+            std::int64_t scale = 0;
+            if (!parse_number(right, scale))
+                std::swap(left, right);
+            if (negative || op.index != -1 || !parse_number(right, scale) || register_size(left) != 8 ||
+                (scale != 1 && scale != 2 && scale != 4 && scale != 8))
+                return false;
+            op.index = HARDWARE_REGISTERS[register_family(left)];
+            op.scale = scale;
+            return true;
+        }
+        if (register_family(term) != -1)
+        {
+            if (negative || register_size(term) != 8)
+                return false;
+            if (op.base == -1)
+                op.base = HARDWARE_REGISTERS[register_family(term)];
+            else if (op.index == -1)
+                op.index = HARDWARE_REGISTERS[register_family(term)];
+            else
+                return false;
+            return true;
+        }
+        std::int64_t n = 0;
+        if (parse_number(term, n))
+        {
+            op.value += negative ? -n : n;
+            return true;
+        }
+        if (negative || !op.symbol.empty() || !is_symbol(term))
+            return false;
+        op.symbol = term;
+        return true;
+    }
+
+    bool parse_operand(std::string_view text, operand& op)
+    {
+        op = { operand_kinds::NONE, 0, -1, 0, -1, -1, 1, "" };
+        static const std::pair<const char*, int> SIZES[] = { { "byte", 1 }, { "word", 2 }, { "dword", 4 }, { "qword", 8 } };
+        for (auto& [name, size] : SIZES)
+        {
+            std::size_t length = std::strlen(name);
+            if (text.length() > length && text.substr(0, length) == name && (text[length] == ' ' || text[length] == '['))
+            {
+                if (text.find('[') == std::string_view::npos)
+                    return false;
+                op.size = size;
+                text = text.substr(text.find('['));
+                break;
+            }
+        }
+        if (!text.empty() && text[0] == '[')
+        {
+            if (text.back() != ']')
+                return false;
+            op.kind = operand_kinds::MEMORY;
+            std::string inner = trim(std::string(text.substr(1, text.length() - 2)));
+            bool rip = inner.substr(0, 4) == "rel ";
+            if (rip)
+                inner = inner.substr(4);
+            std::string term;
+            bool negative = false;
+            for (char c : inner + '+')
+            {
+                if (c != '+' && c != '-')
+                {
+                    term += c;
+                    continue;
+                }
+                if (trim(term).length() != 0 && !memory_term(term, negative, op))
+                    return false;
+                term.clear();
+                negative = c == '-';
+            }
+            // only rip relative symbols, as absolute addresses cannot be position independent
+            if (!fits32(op.value) || op.index == 4 || rip != !op.symbol.empty() || (rip && (op.base != -1 || op.index != -1)))
+                return false;
+            return true;
+        }
+        if (op.size != 0)
+            return false;
+        std::int64_t vector = 0;
+        std::string_view family = text.substr(0, 3);
+        if (text.length() > 3 && (family == "xmm" || family == "ymm" || family == "zmm") && parse_number(text.substr(3), vector) && vector >= 0 && vector < 16)
+        {
+            op.kind = operand_kinds::VECTOR;
+            op.reg = vector;
+            op.size = family == "xmm" ? 16 : family == "ymm" ? 32 : 64;
+            return true;
+        }
+        if (register_family(text) != -1)
+        {
+            op.kind = operand_kinds::REGISTER;
+            op.reg = HARDWARE_REGISTERS[register_family(text)];
+            op.size = register_size(text);
+            return true;
+        }
+        if (parse_number(text, op.value))
+        {
+            op.kind = operand_kinds::IMMEDIATE;
+            return true;
+        }
+        const std::string_view PLT = " wrt ..plt";
+        if (text.length() > PLT.length() && text.substr(text.length() - PLT.length()) == PLT)
+            text.remove_suffix(PLT.length());
+        if (!is_symbol(text))
+            return false;
+        op.kind = operand_kinds::SYMBOL;
+        op.symbol = text;
+        return true;
+    }
+
+    // the operand size of a two operand instruction, 0 when the operands disagree or never say
+    int pair_size(const operand& a, const operand& b)
+    {
+        int sa = a.kind == operand_kinds::REGISTER || a.kind == operand_kinds::MEMORY ? a.size : 0;
+        int sb = b.kind == operand_kinds::REGISTER || b.kind == operand_kinds::MEMORY ? b.size : 0;
+        if (sa != 0 && sb != 0 && sa != sb)
+            return 0;
+        return sa != 0 ? sa : sb;
+    }
+
+    // spl, bpl, sil and dil only exist with a rex prefix
+    bool needs_rex(int size, const operand& a, const operand& b)
+    {
+        return size == 1 && ((a.kind == operand_kinds::REGISTER && a.reg >= 4 && a.reg < 8) ||
+            (b.kind == operand_kinds::REGISTER && b.reg >= 4 && b.reg < 8));
+    }
+
+    int scale_bits(int scale)
+    {
+        return scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+    }
+
+    void put(encoder& e, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            e.code.push_back(value >> (i * 8) & 0xFF);
+    }
+
+    // the extension bits of rm's registers: the index's high bit, then the base's or
+    // the register's own
+    int index_bit(const operand& rm)
+    {
+        return rm.kind == operand_kinds::MEMORY && rm.index != -1 ? rm.index >> 3 & 1 : 0;
+    }
+
+    int base_bit(const operand& rm)
+    {
+        bool direct = rm.kind == operand_kinds::REGISTER || rm.kind == operand_kinds::VECTOR;
+        return (direct ? rm.reg : rm.base != -1 ? rm.base : 0) >> 3 & 1;
+    }
+
+    // modrm, sib and displacement. evex scales 8-bit displacements by the vector
+    // size, so full ones are used there instead
+    void modrm(encoder& e, int reg, const operand& rm, int trailing, bool full = false)
+    {
+        bool direct = rm.kind == operand_kinds::REGISTER || rm.kind == operand_kinds::VECTOR;
+        if (direct)
+        {
+            put(e, 0xC0 | (reg & 7) << 3 | (rm.reg & 7), 1);
+            return;
+        }
+        if (!rm.symbol.empty())
+        {
+            put(e, (reg & 7) << 3 | 5, 1);
+            e.fixups.push_back({ e.code.size(), rm.symbol, fixup_kinds::RELATIVE, rm.value - 4 - trailing });
+            put(e, 0, 4);
+            return;
+        }
+        if (rm.base == -1)
+        {
+            put(e, (reg & 7) << 3 | 4, 1);
+            put(e, scale_bits(rm.scale) << 6 | (rm.index == -1 ? 4 : rm.index & 7) << 3 | 5, 1);
+            put(e, rm.value, 4);
+            return;
+        }
+        // rbp and r13 have no form without a displacement, rsp and r12 always need a sib
+        int mod = rm.value == 0 && (rm.base & 7) != 5 ? 0 : fits8(rm.value) && (!full || rm.value == 0) ? 1 : 2;
+        if (rm.index != -1 || (rm.base & 7) == 4)
+        {
+            put(e, mod << 6 | (reg & 7) << 3 | 4, 1);
+            put(e, scale_bits(rm.scale) << 6 | (rm.index == -1 ? 4 : rm.index & 7) << 3 | (rm.base & 7), 1);
+        }
+        else
+            put(e, mod << 6 | (reg & 7) << 3 | (rm.base & 7), 1);
+        if (mod == 1)
+            put(e, rm.value, 1);
+        else if (mod == 2)
+            put(e, rm.value, 4);
+    }
+
+    // prefixes, opcode, modrm, sib and displacement of an instruction taking reg (a
+    // register or an opcode extension) and rm. size 0 is for instructions whose
+    // operand size is fixed. trailing is the size of the immediate that follows,
+    // which rip relative displacements are measured past
+    void emit(encoder& e, std::initializer_list<unsigned char> opcode, int size, int reg, const operand& rm, int trailing, bool rex = false)
+    {
+        if (size == 2)
+            put(e, 0x66, 1);
+        unsigned int prefix = 0x40 | (size == 8) << 3 | (reg >> 3 & 1) << 2 | index_bit(rm) << 1 | base_bit(rm);
+        if (prefix != 0x40 || rex)
+            put(e, prefix, 1);
+        for (unsigned char b : opcode)
+            put(e, b, 1);
+        modrm(e, reg, rm, trailing);
+    }
+
+    // the opcode + register forms: push, pop and moves of immediates into registers
+    void emit_register(encoder& e, unsigned char opcode, int size, int reg)
+    {
+        if (size == 2)
+            put(e, 0x66, 1);
+        unsigned int prefix = 0x40 | (size == 8) << 3 | (reg >> 3 & 1);
+        if (prefix != 0x40 || (size == 1 && reg >= 4 && reg < 8))
+            put(e, prefix, 1);
+        put(e, opcode + (reg & 7), 1);
+    }
+
+    // sse instructions put their mandatory prefix ahead of any rex
+    void emit_sse(encoder& e, unsigned char prefix, unsigned char opcode, int size, int reg, const operand& rm, unsigned char map = 1)
+    {
+        if (prefix != 0)
+            put(e, prefix, 1);
+        if (map == 2)
+            emit(e, { 0x0F, 0x38, opcode }, size, reg, rm, 0);
+        else
+            emit(e, { 0x0F, opcode }, size, reg, rm, 0);
+    }
+
+    // avx instructions fold the mandatory prefix, the opcode map, rex and a second
+    // source into a vex prefix, two bytes when nothing needs the third, or an evex
+    // one for zmm registers. size is that of the vectors
+    void emit_avx(encoder& e, unsigned char prefix, unsigned char map, unsigned char opcode, bool wide, int size, int reg, int source, const operand& rm)
+    {
+        int pp = prefix == 0x66 ? 1 : prefix == 0xF3 ? 2 : prefix == 0xF2 ? 3 : 0;
+        int r = ~reg >> 3 & 1, x = ~index_bit(rm) & 1, b = ~base_bit(rm) & 1;
+        if (size == 64)
+        {
+            put(e, 0x62, 1);
+            put(e, r << 7 | x << 6 | b << 5 | 1 << 4 | map, 1);
+            put(e, wide << 7 | (~source & 15) << 3 | 1 << 2 | pp, 1);
+            put(e, 2 << 5 | 1 << 3, 1); // 512 bits, no masking
+            put(e, opcode, 1);
+            modrm(e, reg, rm, 0, true);
+            return;
+        }
+        int last = (~source & 15) << 3 | (size == 32) << 2 | pp;
+        if (map == 1 && x == 1 && b == 1)
+        {
+            put(e, 0xC5, 1);
+            put(e, r << 7 | last, 1);
+        }
+        else
+        {
+            put(e, 0xC4, 1);
+            put(e, r << 7 | x << 6 | b << 5 | map, 1);
+            put(e, last, 1);
+        }
+        put(e, opcode, 1);
+        modrm(e, reg, rm, 0);
+    }
+
+    void branch(encoder& e, std::initializer_list<unsigned char> opcode, const std::string& target)
+    {
+        for (unsigned char b : opcode)
+            put(e, b, 1);
+        e.fixups.push_back({ e.code.size(), target, fixup_kinds::BRANCH, -4 });
+        put(e, 0, 4);
+    }
+
+    std::string encoder::qualify(const std::string& name)
+    {
+        return name.length() != 0 && name[0] == '.' ? scope + name : name;
+    }
+
+    bool encoder::label(const std::string& name)
+    {
+        std::string full = qualify(name);
+        if (name.length() != 0 && name[0] != '.')
+            scope = name;
+        if (!labels.emplace(full, code.size()).second)
+        {
+            arrow::err("label '" + full + "' is defined twice");
+            return false;
+        }
+        return true;
+    }
+
+    bool encoder::encode(const instruction& given)
+    {
+        instruction in = given;
+        if (in.raw)
+            in = parse_instruction(in.mnemonic.substr(0, in.mnemonic.find(';')));
+        const std::string& m = in.mnemonic;
+        if (m.empty())
+            return true;
+        if (m.back() == ':' && in.operands.empty())
+            return label(m.substr(0, m.length() - 1));
+        std::vector<operand> ops(in.operands.size());
+        bool good = true;
+        for (std::size_t i = 0; i < ops.size() && good; i++)
+        {
+            good = parse_operand(in.operands[i], ops[i]);
+            ops[i].symbol = qualify(ops[i].symbol);
+        }
+        if (good && (m == "rep" || m == "repe" || m == "repz") && ops.size() == 1 && ops[0].kind == operand_kinds::SYMBOL)
+        {
+            for (auto& [name, opcode] : BARE)
+            {
+                std::string_view string_op = name;
+                if (ops[0].symbol == name && (string_op.substr(0, 4) == "stos" || string_op.substr(0, 4) == "movs"))
+                {
+                    put(*this, 0xF3, 1);
+                    for (unsigned char b : opcode)
+                        put(*this, b, 1);
+                    return true;
+                }
+            }
+            good = false;
+        }
+        if (good && ops.empty())
+        {
+            for (auto& [name, opcode] : BARE)
+            {
+                if (m == name)
+                {
+                    for (unsigned char b : opcode)
+                        put(*this, b, 1);
+                    return true;
+                }
+            }
+            good = false;
+        }
+        if (!good)
+        {
+            arrow::err("cannot encode '" + render_instruction(given) + "', use --emit=asm and an external assembler instead");
+            return false;
+        }
+        std::size_t start = code.size();
+        operand none = { operand_kinds::NONE, 0, -1, 0, -1, -1, 1, "" };
+        operand& a = ops[0];
+        operand& b = ops.size() > 1 ? ops[1] : none;
+        bool register_or_memory = a.kind == operand_kinds::REGISTER || a.kind == operand_kinds::MEMORY;
+        for (auto& [name, ext] : ARITHMETIC)
+        {
+            if (m != name || ops.size() != 2 || !register_or_memory)
+                continue;
+            int size = pair_size(a, b);
+            if (size == 0)
+                break;
+            if (b.kind == operand_kinds::REGISTER)
+                emit(*this, { (unsigned char) (ext << 3 | (size == 1 ? 0 : 1)) }, size, b.reg, a, 0, needs_rex(size, a, b));
+            else if (b.kind == operand_kinds::MEMORY && a.kind == operand_kinds::REGISTER)
+                emit(*this, { (unsigned char) (ext << 3 | (size == 1 ? 2 : 3)) }, size, a.reg, b, 0, needs_rex(size, a, b));
+            else if (b.kind == operand_kinds::IMMEDIATE && size != 1 && fits8(b.value))
+            {
+                emit(*this, { 0x83 }, size, ext, a, 1);
+                put(*this, b.value, 1);
+            }
+            else if (b.kind == operand_kinds::IMMEDIATE && fits(b.value, size))
+            {
+                int bytes = size == 8 ? 4 : size;
+                emit(*this, { (unsigned char) (size == 1 ? 0x80 : 0x81) }, size, ext, a, bytes, needs_rex(size, a, b));
+                put(*this, b.value, bytes);
+            }
+            break;
+        }
+        for (auto& [name, ext] : SHIFTS)
+        {
+            if (m != name || ops.size() != 2 || !register_or_memory || a.size == 0)
+                continue;
+            bool by_one = b.kind == operand_kinds::IMMEDIATE && b.value == 1;
+            if (b.kind == operand_kinds::REGISTER && b.reg == 1 && b.size == 1)
+                emit(*this, { (unsigned char) (a.size == 1 ? 0xD2 : 0xD3) }, a.size, ext, a, 0, needs_rex(a.size, a, none));
+            else if (by_one)
+                emit(*this, { (unsigned char) (a.size == 1 ? 0xD0 : 0xD1) }, a.size, ext, a, 0, needs_rex(a.size, a, none));
+            else if (b.kind == operand_kinds::IMMEDIATE && b.value >= 0 && b.value < 64)
+            {
+                emit(*this, { (unsigned char) (a.size == 1 ? 0xC0 : 0xC1) }, a.size, ext, a, 1, needs_rex(a.size, a, none));
+                put(*this, b.value, 1);
+            }
+            break;
+        }
+        for (auto& [name, form] : UNARY)
+        {
+            if (m == name && ops.size() == 1 && register_or_memory && a.size != 0)
+                emit(*this, { (unsigned char) (form.first + (a.size == 1 ? 0 : 1)) }, a.size, form.second, a, 0, needs_rex(a.size, a, none));
+        }
+        if (m == "mov" && ops.size() == 2 && register_or_memory)
+        {
+            int size = pair_size(a, b);
+            if (a.kind == operand_kinds::REGISTER && b.kind == operand_kinds::IMMEDIATE)
+            {
+                // moves into 32-bit registers clear the upper half, so small 64-bit ones can use them
+                if (a.size == 8 && b.value >= 0 && b.value <= UINT32_MAX)
+                {
+                    emit_register(*this, 0xB8, 4, a.reg);
+                    put(*this, b.value, 4);
+                }
+                else if (a.size == 8 && fits32(b.value))
+                {
+                    emit(*this, { 0xC7 }, 8, 0, a, 4);
+                    put(*this, b.value, 4);
+                }
+                else if (a.size == 8 || fits(b.value, a.size))
+                {
+                    emit_register(*this, a.size == 1 ? 0xB0 : 0xB8, a.size, a.reg);
+                    put(*this, b.value, a.size);
+                }
+            }
+            else if (a.kind == operand_kinds::REGISTER && b.kind == operand_kinds::SYMBOL && a.size == 8)
+            {
+                emit_register(*this, 0xB8, 8, a.reg);
+                fixups.push_back({ code.size(), b.symbol, fixup_kinds::ABSOLUTE, 0 });
+                put(*this, 0, 8);
+            }
+            else if (size != 0 && b.kind == operand_kinds::REGISTER)
+                emit(*this, { (unsigned char) (size == 1 ? 0x88 : 0x89) }, size, b.reg, a, 0, needs_rex(size, a, b));
+            else if (size != 0 && b.kind == operand_kinds::MEMORY && a.kind == operand_kinds::REGISTER)
+                emit(*this, { (unsigned char) (size == 1 ? 0x8A : 0x8B) }, size, a.reg, b, 0, needs_rex(size, a, b));
+            else if (size != 0 && b.kind == operand_kinds::IMMEDIATE && fits(b.value, size))
+            {
+                int bytes = size == 8 ? 4 : size;
+                emit(*this, { (unsigned char) (size == 1 ? 0xC6 : 0xC7) }, size, 0, a, bytes);
+                put(*this, b.value, bytes);
+            }
+        }
+        if ((m == "movzx" || m == "movsx") && ops.size() == 2 && a.kind == operand_kinds::REGISTER && a.size > 1 &&
+            (b.kind == operand_kinds::REGISTER || b.kind == operand_kinds::MEMORY) && (b.size == 1 || b.size == 2))
+        {
+            unsigned char opcode = (m == "movzx" ? 0xB6 : 0xBE) + (b.size == 2);
+            emit(*this, { 0x0F, opcode }, a.size, a.reg, b, 0, needs_rex(b.size, b, none));
+        }
+        if (m == "movsxd" && ops.size() == 2 && a.kind == operand_kinds::REGISTER && a.size == 8 &&
+            (b.kind == operand_kinds::REGISTER || b.kind == operand_kinds::MEMORY) && b.size != 1 && b.size != 2 && b.size != 8)
+            emit(*this, { 0x63 }, 8, a.reg, b, 0);
+        // scalar moves between vector registers and memory, then moves of bits between
+        // vector and integer registers
+        if ((m == "movss" || m == "movsd") && ops.size() == 2)
+        {
+            unsigned char prefix = m == "movss" ? 0xF3 : 0xF2;
+            int size = m == "movss" ? 4 : 8;
+            if (a.kind == operand_kinds::VECTOR && (b.kind == operand_kinds::VECTOR || (b.kind == operand_kinds::MEMORY && (b.size == 0 || b.size == size))))
+                emit_sse(*this, prefix, 0x10, 0, a.reg, b);
+            else if (a.kind == operand_kinds::MEMORY && b.kind == operand_kinds::VECTOR && (a.size == 0 || a.size == size))
+                emit_sse(*this, prefix, 0x11, 0, b.reg, a);
+        }
+        if ((m == "movd" || m == "movq") && ops.size() == 2)
+        {
+            int size = m == "movd" ? 4 : 8;
+            const operand& other = a.kind == operand_kinds::VECTOR ? b : a;
+            bool fits_other = (other.kind == operand_kinds::REGISTER || other.kind == operand_kinds::MEMORY) && (other.size == 0 || other.size == size);
+            if (a.kind == operand_kinds::VECTOR && fits_other)
+                emit_sse(*this, 0x66, 0x6E, size, a.reg, b);
+            else if (b.kind == operand_kinds::VECTOR && fits_other)
+                emit_sse(*this, 0x66, 0x7E, size, b.reg, a);
+        }
+        for (auto& [name, opcode] : SCALAR)
+        {
+            std::string_view view = m;
+            std::size_t length = std::strlen(name);
+            if (view.length() != length + 2 || view.substr(0, length) != name || (view.substr(length) != "ss" && view.substr(length) != "sd"))
+                continue;
+            bool single = view.substr(length) == "ss";
+            if (ops.size() == 2 && a.kind == operand_kinds::VECTOR && (b.kind == operand_kinds::VECTOR || (b.kind == operand_kinds::MEMORY && (b.size == 0 || b.size == (single ? 4 : 8)))))
+                emit_sse(*this, single ? 0xF3 : 0xF2, opcode, 0, a.reg, b);
+        }
+        // unaligned moves of whole vectors, and packed arithmetic
+        if ((m == "movdqu" || m == "vmovdqu" || m == "vmovdqu32" || m == "vmovdqu64") && ops.size() == 2)
+        {
+            const operand& reg = a.kind == operand_kinds::VECTOR ? a : b;
+            const operand& rm = a.kind == operand_kinds::VECTOR ? b : a;
+            unsigned char opcode = a.kind == operand_kinds::VECTOR ? 0x6F : 0x7F;
+            int size = m == "movdqu" ? 16 : m == "vmovdqu" ? reg.size : 64;
+            bool fitting = reg.kind == operand_kinds::VECTOR && reg.size == size && size <= (m == "vmovdqu" ? 32 : 64) &&
+                ((rm.kind == operand_kinds::VECTOR && rm.size == size) || (rm.kind == operand_kinds::MEMORY && rm.size == 0));
+            if (fitting && m == "movdqu")
+                emit_sse(*this, 0xF3, opcode, 0, reg.reg, rm);
+            else if (fitting)
+                emit_avx(*this, 0xF3, 1, opcode, m == "vmovdqu64", size, reg.reg, 0, rm);
+        }
+        for (const packed_form& p : PACKED)
+        {
+            std::string_view view = m;
+            bool avx = view.length() > 1 && view[0] == 'v' && view.substr(1) == p.name;
+            const operand& c = ops.size() > 2 ? ops[2] : none;
+            if (m == p.name && ops.size() == 2 && a.kind == operand_kinds::VECTOR && a.size == 16 &&
+                ((b.kind == operand_kinds::VECTOR && b.size == 16) || (b.kind == operand_kinds::MEMORY && b.size == 0)))
+                emit_sse(*this, p.prefix, p.opcode, 0, a.reg, b, p.map);
+            else if (avx && ops.size() == 3 && a.kind == operand_kinds::VECTOR && b.kind == operand_kinds::VECTOR && a.size == b.size &&
+                ((c.kind == operand_kinds::VECTOR && c.size == a.size) || (c.kind == operand_kinds::MEMORY && c.size == 0)))
+                emit_avx(*this, p.prefix, p.map, p.opcode, p.wide && a.size == 64, a.size, a.reg, b.reg, c);
+        }
+        if (m == "vpbroadcastq" && ops.size() == 2 && a.kind == operand_kinds::VECTOR && a.size > 16 &&
+            ((b.kind == operand_kinds::VECTOR && b.size == 16) || (b.kind == operand_kinds::MEMORY && (b.size == 0 || b.size == 8))))
+            emit_avx(*this, 0x66, 2, 0x59, a.size == 64, a.size, a.reg, 0, b);
+        if ((m == "cvtss2sd" || m == "cvtsd2ss") && ops.size() == 2 && a.kind == operand_kinds::VECTOR &&
+            (b.kind == operand_kinds::VECTOR || (b.kind == operand_kinds::MEMORY && (b.size == 0 || b.size == (m == "cvtss2sd" ? 4 : 8)))))
+            emit_sse(*this, m == "cvtss2sd" ? 0xF3 : 0xF2, 0x5A, 0, a.reg, b);
+        if (m == "lea" && ops.size() == 2 && a.kind == operand_kinds::REGISTER && a.size >= 4 && b.kind == operand_kinds::MEMORY)
+            emit(*this, { 0x8D }, a.size, a.reg, b, 0);
+        if (m == "test" && ops.size() == 2 && register_or_memory)
+        {
+            int size = pair_size(a, b);
+            if (size != 0 && b.kind == operand_kinds::REGISTER)
+                emit(*this, { (unsigned char) (size == 1 ? 0x84 : 0x85) }, size, b.reg, a, 0, needs_rex(size, a, b));
+            else if (size != 0 && b.kind == operand_kinds::IMMEDIATE && fits(b.value, size))
+            {
+                int bytes = size == 8 ? 4 : size;
+                emit(*this, { (unsigned char) (size == 1 ? 0xF6 : 0xF7) }, size, 0, a, bytes, needs_rex(size, a, b));
+                put(*this, b.value, bytes);
+            }
+        }
+        if (m == "xchg" && ops.size() == 2 && register_or_memory && (b.kind == operand_kinds::REGISTER || b.kind == operand_kinds::MEMORY))
+        {
+            int size = pair_size(a, b);
+            const operand& reg = b.kind == operand_kinds::REGISTER ? b : a;
+            const operand& rm = b.kind == operand_kinds::REGISTER ? a : b;
+            if (size != 0 && reg.kind == operand_kinds::REGISTER)
+                emit(*this, { (unsigned char) (size == 1 ? 0x86 : 0x87) }, size, reg.reg, rm, 0, needs_rex(size, a, b));
+        }
+        if (m == "imul" && a.kind == operand_kinds::REGISTER && a.size > 1 &&
+            (b.kind == operand_kinds::REGISTER || b.kind == operand_kinds::MEMORY) && pair_size(a, b) != 0)
+        {
+            if (ops.size() == 2)
+                emit(*this, { 0x0F, 0xAF }, a.size, a.reg, b, 0);
+            else if (ops.size() == 3 && ops[2].kind == operand_kinds::IMMEDIATE && fits8(ops[2].value))
+            {
+                emit(*this, { 0x6B }, a.size, a.reg, b, 1);
+                put(*this, ops[2].value, 1);
+            }
+            else if (ops.size() == 3 && ops[2].kind == operand_kinds::IMMEDIATE && fits(ops[2].value, a.size))
+            {
+                int bytes = a.size == 8 ? 4 : a.size;
+                emit(*this, { 0x69 }, a.size, a.reg, b, bytes);
+                put(*this, ops[2].value, bytes);
+            }
+        }
+        if (m.substr(0, 4) == "cmov" && condition(m.substr(4)) != -1 && ops.size() == 2 && a.kind == operand_kinds::REGISTER &&
+            a.size > 1 && (b.kind == operand_kinds::REGISTER || b.kind == operand_kinds::MEMORY) && pair_size(a, b) != 0)
+            emit(*this, { 0x0F, (unsigned char) (0x40 + condition(m.substr(4))) }, a.size, a.reg, b, 0);
+        if (m.substr(0, 3) == "set" && condition(m.substr(3)) != -1 && ops.size() == 1 && register_or_memory && a.size <= 1)
+            emit(*this, { 0x0F, (unsigned char) (0x90 + condition(m.substr(3))) }, 0, 0, a, 0, needs_rex(1, a, none));
+        if (m[0] == 'j' && condition(m.substr(1)) != -1 && ops.size() == 1 && a.kind == operand_kinds::SYMBOL)
+            branch(*this, { 0x0F, (unsigned char) (0x80 + condition(m.substr(1))) }, a.symbol);
+        if ((m == "jmp" || m == "call") && ops.size() == 1)
+        {
+            if (a.kind == operand_kinds::SYMBOL)
+                branch(*this, { (unsigned char) (m == "jmp" ? 0xE9 : 0xE8) }, a.symbol);
+            else if ((a.kind == operand_kinds::REGISTER || a.kind == operand_kinds::MEMORY) && (a.size == 8 || a.size == 0))
+                emit(*this, { 0xFF }, 0, m == "jmp" ? 4 : 2, a, 0);
+        }
+        if ((m == "push" || m == "pop") && ops.size() == 1)
+        {
+            if (a.kind == operand_kinds::REGISTER && a.size == 8)
+                emit_register(*this, m == "push" ? 0x50 : 0x58, 0, a.reg);
+            else if (a.kind == operand_kinds::MEMORY && (a.size == 8 || a.size == 0))
+                emit(*this, { (unsigned char) (m == "push" ? 0xFF : 0x8F) }, 0, m == "push" ? 6 : 0, a, 0);
+            else if (m == "push" && a.kind == operand_kinds::IMMEDIATE && fits32(a.value))
+            {
+                put(*this, fits8(a.value) ? 0x6A : 0x68, 1);
+                put(*this, a.value, fits8(a.value) ? 1 : 4);
+            }
+        }
+        if (m == "ret" && ops.size() == 1 && a.kind == operand_kinds::IMMEDIATE && a.value >= 0 && a.value <= UINT16_MAX)
+        {
+            put(*this, 0xC2, 1);
+            put(*this, a.value, 2);
+        }
+        if (code.size() == start)
+        {
+            arrow::err("cannot encode '" + render_instruction(given) + "', use --emit=asm and an external assembler instead");
+            return false;
+        }
+        return true;
+    }
+
+    void encoder::resolve()
+    {
+        std::vector<fixup> unresolved;
+        for (fixup& f : fixups)
+        {
+            auto it = labels.find(f.symbol);
+            if (f.kind == fixup_kinds::ABSOLUTE || it == labels.end())
+            {
+                unresolved.push_back(f);
+                continue;
+            }
+            std::int64_t distance = (std::int64_t) it->second + f.addend - (std::int64_t) f.offset;
+            for (int i = 0; i < 4; i++)
+                code[f.offset + i] = distance >> (i * 8) & 0xFF;
+        }
+        fixups = unresolved;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef ARROW_ENCODER_H
+#define ARROW_ENCODER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "assembler.h"
+
+namespace arrow
+{
+    typedef unsigned int fixup_kind;
+    namespace fixup_kinds
+    {
+        const fixup_kind RELATIVE = 0x00; // 32-bit distance to data, from a rip relative operand
+        const fixup_kind BRANCH = 0x01; // 32-bit distance to code, from a call or jump
+        const fixup_kind ABSOLUTE = 0x02; // 64-bit address
+    }
+
+    // a symbol reference in the code. the field at offset gets the symbol's address
+    // plus addend, less the address of the field itself for the relative kinds
+    typedef struct fixup {
+        std::size_t offset;
+        std::string symbol;
+        fixup_kind kind;
+        std::int64_t addend;
+    } fixup;
+
+    // x86-64 machine code for the part of nasm the code generator and the runtime
+    // write. labels starting with '.' belong to the last label without one
+    class encoder
+    {
+    private:
+        std::string scope;
+    public:
+        std::vector<unsigned char> code;
+        std::map<std::string, std::size_t> labels;
+        std::vector<fixup> fixups;
+
+        std::string qualify(const std::string& name);
+        bool label(const std::string& name);
+        bool encode(const instruction& in); // reports an error and returns false for anything outside the subset
+        void resolve(); // fills in references to labels of the code, leaving the rest in fixups
+    };
+}
+
+#endif
\ No newline at end of file
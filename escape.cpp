@@ -0,0 +1,80 @@
+#include <algorithm>
+
+#include "escape.h"
+
+namespace arrow
+{
+    std::vector<std::string> demote_references(ir_module& module)
+    {
+        std::vector<std::string> report;
+        for (ir_function& fn : module.functions)
+        {
+            std::size_t count = fn.slots.size();
+            std::vector<ir_node*> allocations(count, nullptr);
+            std::vector<bool> eligible(count, true);
+            std::vector<bool> freed(count, false);
+            std::vector<int> loaded(fn.values.size(), -1); // slot a value was loaded from
+            std::vector<const ir_node*> producers(fn.values.size(), nullptr);
+            auto escape = [&](std::uint32_t v)
+            {
+                if (v != NO_VALUE && loaded[v] != -1)
+                    eligible[loaded[v]] = false;
+            };
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.dst != NO_VALUE)
+                        producers[n.dst] = &n;
+                    // the address operand of a load or store is the only use that
+                    // does not let the pointer get away
+                    if (n.op != ir_ops::LOAD && n.op != ir_ops::STORE && ir_ops::reads_a(n.op))
+                        escape(n.a);
+                    if (ir_ops::reads_b(n.op))
+                        escape(n.b);
+                    switch (n.op)
+                    {
+                        case ir_ops::LOAD_SLOT:
+                            loaded[n.dst] = n.imm;
+                            break;
+                        case ir_ops::STORE_SLOT:
+                            eligible[n.imm] = false;
+                            break;
+                        case ir_ops::ALLOC:
+                            if (allocations[n.imm] != nullptr)
+                                eligible[n.imm] = false;
+                            allocations[n.imm] = &n;
+                            break;
+                        case ir_ops::FREE:
+                            freed[n.imm] = true;
+                            break;
+                    }
+                }
+            }
+            std::vector<bool> demoted(count, false);
+            for (std::size_t s = 0; s < count; s++)
+            {
+                ir_node* alloc = allocations[s];
+                if (alloc == nullptr || !eligible[s] || !freed[s])
+                    continue;
+                const ir_node* size = producers[alloc->a];
+                const ir_node* alignment = alloc->b != NO_VALUE ? producers[alloc->b] : nullptr;
+                if (size == nullptr || size->op != ir_ops::CONST || size->imm < 0 || size->imm > FRAME_ALLOC_LIMIT)
+                    continue;
+                if (alignment != nullptr && alignment->imm > 16)
+                    continue; // the frame itself is only 16 byte aligned
+                alloc->op = ir_ops::FRAME_ALLOC;
+                demoted[s] = true;
+                report.push_back("reference '" + fn.slots[s].name + "' of " + fn.name + " moved to the frame (" + std::to_string(size->imm) + " bytes)");
+            }
+            for (ir_block& block : fn.blocks)
+            {
+                block.nodes.erase(std::remove_if(block.nodes.begin(), block.nodes.end(), [&](const ir_node& n)
+                {
+                    return n.op == ir_ops::FREE && demoted[n.imm];
+                }), block.nodes.end());
+            }
+        }
+        return report;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef ARROW_ESCAPE_H
+#define ARROW_ESCAPE_H
+
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+namespace arrow
+{
+    // the most a single reference may take out of a frame
+    const int FRAME_ALLOC_LIMIT = 256;
+
+    // moves the memory of references that never outlive their label into the label's
+    // frame. a reference qualifies when it is created once with a constant size, is
+    // deleted in the same label, and its pointer is only ever dereferenced: never
+    // passed, returned, stored, added or assigned to another reference. its del is
+    // dropped. returns a line describing each reference that was moved
+    std::vector<std::string> demote_references(ir_module& module);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+
+#include "fold.h"
+
+namespace arrow
+{
+    // what is known to be at the start of an allocation: the bits of its first size bytes
+    typedef struct known_memory {
+        std::uint64_t bits;
+        int size;
+    } known_memory;
+
+    std::uint64_t low_bytes(std::uint64_t bits, int size)
+    {
+        return size >= 8 ? bits : bits & ((1ULL << size * 8) - 1);
+    }
+
+    // the value a load of type gives for the bits in memory. integers are sign
+    // extended as they are loaded, floats keep only their own bits like literals do
+    std::int64_t loaded(std::uint64_t bits, value_type type)
+    {
+        int size = value_types::size(type);
+        bits = low_bytes(bits, size);
+        if (size >= 8 || value_types::floating(type))
+            return bits;
+        std::uint64_t sign = 1ULL << (size * 8 - 1);
+        return (bits ^ sign) - sign;
+    }
+
+    std::int64_t sum(value_type type, std::int64_t a, std::int64_t b)
+    {
+        if (type == value_types::F32)
+        {
+            float x = 0, y = 0;
+            std::memcpy(&x, &a, sizeof(x));
+            std::memcpy(&y, &b, sizeof(y));
+            float s = x + y;
+            std::int64_t bits = 0;
+            std::memcpy(&bits, &s, sizeof(s));
+            return bits;
+        }
+        if (type == value_types::F64)
+        {
+            double x = 0, y = 0;
+            std::memcpy(&x, &a, sizeof(x));
+            std::memcpy(&y, &b, sizeof(y));
+            double s = x + y;
+            std::int64_t bits = 0;
+            std::memcpy(&bits, &s, sizeof(s));
+            return bits;
+        }
+        return (std::uint64_t) a + (std::uint64_t) b; // wraps like the add it replaces
+    }
+
+    std::string show(value_type type, std::int64_t constant)
+    {
+        if (type == value_types::F32)
+        {
+            float f = 0;
+            std::memcpy(&f, &constant, sizeof(f));
+            return std::to_string(f);
+        }
+        if (type == value_types::F64)
+        {
+            double d = 0;
+            std::memcpy(&d, &constant, sizeof(d));
+            return std::to_string(d);
+        }
+        return std::to_string(constant);
+    }
+
+    void fold_label(ir_function& fn, std::vector<std::string>& report)
+    {
+        std::vector<ir_node*> sequence;
+        for (ir_block& block : fn.blocks)
+        {
+            for (ir_node& n : block.nodes)
+                sequence.push_back(&n);
+        }
+        // allocations are numbered as they are made. a pointer value points to the
+        // start of one, or is -1 when where it points is not known
+        std::vector<int> object(fn.values.size(), -1);
+        std::vector<int> slot_object(fn.slots.size(), -1);
+        std::vector<bool> escaped;
+        std::vector<std::string> names;
+        std::vector<bool> known(fn.values.size(), false);
+        std::vector<std::int64_t> constants(fn.values.size(), 0);
+        std::map<int, known_memory> memory;
+        std::map<const ir_node*, int> allocated, freed;
+        auto escape = [&](std::uint32_t v)
+        {
+            if (v != NO_VALUE && object[v] != -1)
+                escaped[object[v]] = true;
+        };
+        // what the rest of the program can reach may change under a call or a
+        // store through a pointer that is not followed
+        auto forget_escaped = [&]()
+        {
+            for (auto it = memory.begin(); it != memory.end();)
+                it = escaped[it->first] ? memory.erase(it) : std::next(it);
+        };
+        auto fold = [&](ir_node& n, std::int64_t constant)
+        {
+            n.op = ir_ops::CONST;
+            n.a = NO_VALUE;
+            n.b = NO_VALUE;
+            n.imm = constant;
+        };
+        for (ir_node* node : sequence)
+        {
+            ir_node& n = *node;
+            // dereferencing a pointer or setting it into another reference is the
+            // only use that does not let it get away
+            if (n.op != ir_ops::LOAD && n.op != ir_ops::STORE && n.op != ir_ops::STORE_SLOT && ir_ops::reads_a(n.op))
+                escape(n.a);
+            if (ir_ops::reads_b(n.op))
+                escape(n.b);
+            switch (n.op)
+            {
+                case ir_ops::CONST:
+                    known[n.dst] = true;
+                    constants[n.dst] = n.imm;
+                    break;
+                case ir_ops::ADD:
+                    if (!known[n.a] || !known[n.b])
+                        break;
+                    fold(n, sum(n.type, constants[n.a], constants[n.b]));
+                    known[n.dst] = true;
+                    constants[n.dst] = n.imm;
+                    report.push_back("addition on line " + std::to_string(n.line) + " of " + fn.name + " folded to " + show(n.type, n.imm));
+                    break;
+                case ir_ops::LOAD:
+                {
+                    auto it = object[n.a] != -1 ? memory.find(object[n.a]) : memory.end();
+                    if (it == memory.end() || it->second.size < value_types::size(n.type))
+                        break;
+                    std::string name = names[object[n.a]];
+                    fold(n, loaded(it->second.bits, n.type));
+                    known[n.dst] = true;
+                    constants[n.dst] = n.imm;
+                    report.push_back("load of '" + name + "' on line " + std::to_string(n.line) + " of " + fn.name + " replaced by " + show(n.type, n.imm));
+                    break;
+                }
+                case ir_ops::STORE:
+                {
+                    int target = object[n.a];
+                    if (target == -1)
+                    {
+                        forget_escaped();
+                        break;
+                    }
+                    if (!known[n.b])
+                    {
+                        memory.erase(target);
+                        break;
+                    }
+                    // a narrower store only replaces the low bytes of what is known
+                    int size = value_types::size(n.type);
+                    std::uint64_t bits = low_bytes(constants[n.b], size);
+                    auto it = memory.find(target);
+                    if (it != memory.end() && it->second.size > size)
+                        it->second.bits = (it->second.bits & ~low_bytes(UINT64_MAX, size)) | bits;
+                    else
+                        memory[target] = { bits, size };
+                    break;
+                }
+                case ir_ops::LOAD_SLOT:
+                    object[n.dst] = slot_object[n.imm];
+                    break;
+                case ir_ops::STORE_SLOT:
+                    slot_object[n.imm] = object[n.a];
+                    break;
+                case ir_ops::ALLOC:
+                case ir_ops::FRAME_ALLOC:
+                    allocated[&n] = escaped.size();
+                    slot_object[n.imm] = escaped.size();
+                    escaped.push_back(false);
+                    names.push_back(fn.slots[n.imm].name);
+                    break;
+                case ir_ops::FREE:
+                    freed[&n] = slot_object[n.imm];
+                    memory.erase(slot_object[n.imm]);
+                    break;
+                case ir_ops::CALL:
+                case ir_ops::BULK:
+                    forget_escaped();
+                    break;
+                case ir_ops::ASM:
+                    // inline assembly can reach every reference and slot there is
+                    std::fill(escaped.begin(), escaped.end(), true);
+                    std::fill(slot_object.begin(), slot_object.end(), -1);
+                    memory.clear();
+                    break;
+            }
+        }
+        // backwards, the bytes at the start of each allocation that are written
+        // again or go away before they are read. nothing reads the memory of an
+        // allocation that never escaped once the label is over
+        std::vector<int> dead(escaped.size(), INT_MAX);
+        std::vector<bool> removed(sequence.size(), false);
+        for (std::size_t i = sequence.size(); i-- > 0;)
+        {
+            ir_node& n = *sequence[i];
+            int target = n.op == ir_ops::LOAD || n.op == ir_ops::STORE ? object[n.a] : n.op == ir_ops::FREE ? freed[&n] : -1;
+            if (target == -1 || escaped[target])
+                continue;
+            if (n.op == ir_ops::LOAD)
+                dead[target] = 0;
+            else if (n.op == ir_ops::FREE)
+                dead[target] = INT_MAX;
+            else if (dead[target] >= value_types::size(n.type))
+            {
+                removed[i] = true;
+                report.push_back("store to '" + names[target] + "' on line " + std::to_string(n.line) + " of " + fn.name + " removed, nothing reads it");
+            }
+            else
+                dead[target] = value_types::size(n.type);
+        }
+        // allocations nothing goes through any more are not made at all
+        std::vector<bool> accessed(escaped.size(), false);
+        for (std::size_t i = 0; i < sequence.size(); i++)
+        {
+            ir_node& n = *sequence[i];
+            if (!removed[i] && (n.op == ir_ops::LOAD || n.op == ir_ops::STORE) && object[n.a] != -1)
+                accessed[object[n.a]] = true;
+        }
+        for (std::size_t i = 0; i < sequence.size(); i++)
+        {
+            ir_node& n = *sequence[i];
+            int target = n.op == ir_ops::ALLOC || n.op == ir_ops::FRAME_ALLOC ? allocated[&n] : n.op == ir_ops::FREE ? freed[&n] : -1;
+            if (target == -1 || escaped[target] || accessed[target])
+                continue;
+            removed[i] = true;
+            if (n.op != ir_ops::FREE)
+                report.push_back("reference '" + names[target] + "' of " + fn.name + " no longer needs its memory");
+        }
+        // then whatever computed the values those stores and folded nodes used
+        std::vector<int> uses(fn.values.size(), 0);
+        for (std::size_t i = 0; i < sequence.size(); i++)
+        {
+            ir_node& n = *sequence[i];
+            if (removed[i])
+                continue;
+            if (ir_ops::reads_a(n.op) && n.a != NO_VALUE)
+                uses[n.a]++;
+            if (ir_ops::reads_b(n.op) && n.b != NO_VALUE)
+                uses[n.b]++;
+        }
+        for (std::size_t i = sequence.size(); i-- > 0;)
+        {
+            ir_node& n = *sequence[i];
+            bool pure = n.op == ir_ops::CONST || n.op == ir_ops::STRING || n.op == ir_ops::LOAD_SLOT || n.op == ir_ops::LOAD || n.op == ir_ops::ADD;
+            if (removed[i] || !pure || uses[n.dst] != 0)
+                continue;
+            removed[i] = true;
+            if (ir_ops::reads_a(n.op))
+                uses[n.a]--;
+            if (ir_ops::reads_b(n.op))
+                uses[n.b]--;
+        }
+        std::size_t i = 0;
+        for (ir_block& block : fn.blocks)
+        {
+            std::vector<ir_node> nodes;
+            for (ir_node& n : block.nodes)
+            {
+                if (!removed[i++])
+                    nodes.push_back(n);
+            }
+            block.nodes = nodes;
+        }
+    }
+
+    std::vector<std::string> fold_constants(ir_module& module)
+    {
+        std::vector<std::string> report;
+        for (ir_function& fn : module.functions)
+            fold_label(fn, report);
+        return report;
+    }
+}
\ No newline at end of file
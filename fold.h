@@ -0,0 +1,24 @@
+#ifndef ARROW_FOLD_H
+#define ARROW_FOLD_H
+
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+namespace arrow
+{
+    // folds additions of constants, and loads of reference memory whose contents are
+    // known to be constants, into constants, so what is passed or stored from them
+    // becomes an immediate. memory is only followed for references whose pointer never
+    // leaves the label: it is only dereferenced or set into another reference. stores
+    // to such memory are removed when it is overwritten or goes away before anything
+    // reads it, and values nothing uses any more go with them. returns a line
+    // describing each change
+    std::vector<std::string> fold_constants(ir_module& module);
+
+    // the same for a single label, adding its lines to report
+    void fold_label(ir_function& fn, std::vector<std::string>& report);
+}
+
+#endif
\ No newline at end of file
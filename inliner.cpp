@@ -0,0 +1,210 @@
+#include <map>
+#include <set>
+
+#include "inliner.h"
+
+namespace arrow
+{
+    // how many times labels that became leaves by inlining are looked at again
+    const int INLINE_ROUNDS = 4;
+
+    // a call chosen for inlining: where it is, and the arguments passed to it
+    typedef struct inline_site {
+        std::size_t block;
+        std::size_t node;
+        int callee;
+        std::vector<std::uint32_t> arguments;
+    } inline_site;
+
+    bool slot_op(ir_op op)
+    {
+        return op == ir_ops::LOAD_SLOT || op == ir_ops::STORE_SLOT || op == ir_ops::ALLOC || op == ir_ops::FREE || op == ir_ops::FRAME_ALLOC;
+    }
+
+    // whether fn can be spliced anywhere: it makes no calls of its own, has no
+    // inline asm that might depend on its frame, and is small enough
+    bool inlinable(ir_function& fn, int calls)
+    {
+        std::size_t size = 0;
+        for (ir_block& block : fn.blocks)
+        {
+            for (ir_node& n : block.nodes)
+            {
+                if (n.op == ir_ops::CALL || n.op == ir_ops::ARG || n.op == ir_ops::ASM)
+                    return false;
+                size++;
+            }
+        }
+        return size <= (calls >= HOT_CALLS ? HOT_INLINE_LIMIT : INLINE_LIMIT);
+    }
+
+    // the callee's nodes, renumbered into the caller. returns the value the callee
+    // returned, NO_VALUE when it never did
+    std::uint32_t splice(ir_function& caller, ir_function& callee, const std::vector<std::uint32_t>& arguments, std::vector<ir_node>& out)
+    {
+        std::vector<std::uint32_t> values(callee.values.size(), NO_VALUE);
+        std::vector<int> slots;
+        for (ir_slot& slot : callee.slots)
+            slots.push_back(caller.slot(slot.type, callee.name + '.' + slot.name));
+        std::uint32_t returned = NO_VALUE;
+        for (ir_block& block : callee.blocks)
+        {
+            for (ir_node& n : block.nodes)
+            {
+                if (n.op == ir_ops::PARAM)
+                {
+                    values[n.dst] = arguments[n.imm];
+                    continue;
+                }
+                if (n.op == ir_ops::RET)
+                {
+                    returned = values[n.a];
+                    continue;
+                }
+                ir_node copy = n;
+                if (ir_ops::reads_a(n.op))
+                    copy.a = values[n.a];
+                if (ir_ops::reads_b(n.op) && n.b != NO_VALUE)
+                    copy.b = values[n.b];
+                if (slot_op(n.op))
+                    copy.imm = slots[n.imm];
+                if (n.dst != NO_VALUE)
+                {
+                    copy.dst = caller.value(callee.values[n.dst]);
+                    values[n.dst] = copy.dst;
+                }
+                out.push_back(copy);
+            }
+        }
+        return returned;
+    }
+
+    std::vector<std::string> inline_labels(ir_module& module)
+    {
+        std::vector<std::string> report;
+        // who calls each label and from how many places, resolved once. inlining
+        // only takes calls away, as what is spliced in makes none
+        std::vector<int> calls(module.functions.size(), 0);
+        std::vector<std::vector<std::size_t>> callers(module.functions.size());
+        for (std::size_t c = 0; c < module.functions.size(); c++)
+        {
+            for (ir_block& block : module.functions[c].blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    int callee = n.op == ir_ops::CALL ? module.find_function(module.names[n.imm]) : -1;
+                    if (callee == -1)
+                        continue;
+                    calls[callee]++;
+                    if (callers[callee].empty() || callers[callee].back() != c)
+                        callers[callee].push_back(c);
+                }
+            }
+        }
+        std::vector<bool> candidates;
+        for (std::size_t f = 0; f < module.functions.size(); f++)
+            candidates.push_back(inlinable(module.functions[f], calls[f]));
+        // every label is looked through once, then only those calling a label that
+        // became a candidate in the round before
+        std::set<std::size_t> visit;
+        for (std::size_t c = 0; c < module.functions.size(); c++)
+            visit.insert(c);
+        for (int round = 0; round < INLINE_ROUNDS && !visit.empty(); round++)
+        {
+            std::vector<std::size_t> changed;
+            for (std::size_t c : visit)
+            {
+                ir_function& fn = module.functions[c];
+                // arguments wait for the next call, which may be in a later block
+                std::map<std::int64_t, std::pair<std::size_t, std::size_t>> pending;
+                std::vector<inline_site> sites;
+                std::vector<std::vector<bool>> dropped;
+                for (std::size_t b = 0; b < fn.blocks.size(); b++)
+                {
+                    dropped.emplace_back(fn.blocks[b].nodes.size(), false);
+                    for (std::size_t i = 0; i < fn.blocks[b].nodes.size(); i++)
+                    {
+                        ir_node& n = fn.blocks[b].nodes[i];
+                        if (n.op == ir_ops::ARG)
+                            pending[n.imm] = { b, i };
+                        if (n.op == ir_ops::BULK)
+                            pending.clear();
+                        if (n.op != ir_ops::CALL)
+                            continue;
+                        int callee = module.find_function(module.names[n.imm]);
+                        bool complete = pending.size() == n.a && (n.a == 0 || pending.rbegin()->first == n.a - 1);
+                        if (callee != -1 && callee != (int) c && candidates[callee] && complete && module.functions[callee].params <= (int) n.a)
+                        {
+                            inline_site site = { b, i, callee, {} };
+                            for (auto& [index, where] : pending)
+                            {
+                                site.arguments.push_back(fn.blocks[where.first].nodes[where.second].a);
+                                dropped[where.first][where.second] = true;
+                            }
+                            sites.push_back(site);
+                        }
+                        pending.clear();
+                    }
+                }
+                if (sites.empty())
+                    continue;
+                changed.push_back(c);
+                for (inline_site& site : sites)
+                    calls[site.callee]--;
+                // results of inlined calls are replaced by what the callee returned
+                std::vector<std::uint32_t> replaced(fn.values.size(), NO_VALUE);
+                std::size_t next = 0;
+                for (std::size_t b = 0; b < fn.blocks.size(); b++)
+                {
+                    std::vector<ir_node> nodes;
+                    std::vector<ir_node>& old = fn.blocks[b].nodes;
+                    for (std::size_t i = 0; i < old.size(); i++)
+                    {
+                        if (dropped[b][i])
+                            continue;
+                        if (next == sites.size() || sites[next].block != b || sites[next].node != i)
+                        {
+                            nodes.push_back(old[i]);
+                            continue;
+                        }
+                        ir_function& callee = module.functions[sites[next].callee];
+                        std::uint32_t returned = splice(fn, callee, sites[next].arguments, nodes);
+                        if (returned != NO_VALUE)
+                            replaced[old[i].dst] = returned;
+                        else
+                            nodes.push_back({ ir_ops::CONST, old[i].type, old[i].dst, NO_VALUE, NO_VALUE, 0, old[i].line });
+                        report.push_back("label " + callee.name + " inlined into " + fn.name);
+                        next++;
+                    }
+                    old = nodes;
+                }
+                // a callee can hand back what an earlier inlined call returned
+                auto resolve = [&](std::uint32_t& v)
+                {
+                    while (v < replaced.size() && replaced[v] != NO_VALUE)
+                        v = replaced[v];
+                };
+                for (ir_block& block : fn.blocks)
+                {
+                    for (ir_node& n : block.nodes)
+                    {
+                        if (ir_ops::reads_a(n.op))
+                            resolve(n.a);
+                        if (ir_ops::reads_b(n.op))
+                            resolve(n.b);
+                    }
+                }
+            }
+            // only labels that had calls inlined into them can have become leaves
+            visit.clear();
+            for (std::size_t f : changed)
+            {
+                if (candidates[f] || !inlinable(module.functions[f], calls[f]))
+                    continue;
+                candidates[f] = true;
+                visit.insert(callers[f].begin(), callers[f].end());
+            }
+        }
+        return report;
+    }
+}
\ No newline at end of file
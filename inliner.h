@@ -0,0 +1,25 @@
+#ifndef ARROW_INLINER_H
+#define ARROW_INLINER_H
+
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+namespace arrow
+{
+    // the most nodes a label may have to be inlined, and the most for hot labels:
+    // those called from at least HOT_CALLS places
+    const std::size_t INLINE_LIMIT = 24;
+    const std::size_t HOT_INLINE_LIMIT = 64;
+    const int HOT_CALLS = 4;
+
+    // splices small leaf labels into the labels calling them. the values passed
+    // become the callee's pulls directly and its return value replaces the result
+    // of the call, so nothing goes through registers or the frame on the way.
+    // callees that became leaves are considered again, a few rounds deep. returns
+    // a line describing each call that was inlined
+    std::vector<std::string> inline_labels(ir_module& module);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+#include "interpreter.h"
+#include "jit.h"
+#include "logger.h"
+
+// computed goto threads handlers straight into each other. other compilers fall
+// back to a switch over the same cells
+#if defined(__GNUC__)
+#define ARROW_THREADED
+#define CASE(op) handle_##op:
+#define NEXT goto *(pc++)->handler
+#else
+#define CASE(op) case bytecode_ops::op:
+#define NEXT break
+#endif
+
+namespace arrow
+{
+    const std::size_t STACK_WORDS = 1 << 20;
+    const std::int64_t FRAME_ALIGNMENT = 64;
+
+    typedef std::int64_t (*native_function)(...);
+
+    // threaded code: a handler, or the op under a switch, followed by its operands
+    typedef union cell {
+        const void* handler;
+        std::int64_t value;
+    } cell;
+
+    cell operand(std::int64_t value)
+    {
+        cell c;
+        c.value = value;
+        return c;
+    }
+
+    // zeroed blocks aligned to at least 16 bytes, with the start of what was really
+    // allocated kept just below them for release
+    std::int64_t allocate(std::int64_t size, std::int64_t alignment)
+    {
+        alignment = std::max<std::int64_t>(alignment, 16);
+        char* memory = (char*) std::calloc(1, std::max<std::int64_t>(size, 0) + alignment);
+        if (memory == nullptr)
+            return 0;
+        char* block = (char*) (((std::uintptr_t) memory + alignment) & ~(std::uintptr_t) (alignment - 1));
+        ((void**) block)[-1] = memory;
+        return (std::int64_t) block;
+    }
+
+    void release(std::int64_t block)
+    {
+        if (block != 0)
+            std::free(((void**) block)[-1]);
+    }
+
+#if defined(__x86_64__) && !defined(_WIN32)
+    // system v fills integer and vector registers each in their own order, so one
+    // signature with six of each reaches any extern taking no more than that. the
+    // ellipsis makes the caller tell variadic callees about the vector registers
+    typedef std::int64_t (*mixed_function)(std::int64_t, std::int64_t, std::int64_t, std::int64_t, std::int64_t, std::int64_t,
+        double, double, double, double, double, double, double, double, ...);
+    typedef double (*double_function)(std::int64_t, std::int64_t, std::int64_t, std::int64_t, std::int64_t, std::int64_t,
+        double, double, double, double, double, double, double, double, ...);
+    typedef float (*float_function)(std::int64_t, std::int64_t, std::int64_t, std::int64_t, std::int64_t, std::int64_t,
+        double, double, double, double, double, double, double, double, ...);
+#endif
+
+    // calls an extern given or giving back floating point values. a float travels in
+    // the low half of a double's register, as its bits are all the callee reads
+    std::int64_t call_real(const void* function, const std::int64_t* arguments, std::int64_t count, std::int64_t kinds, std::int64_t result)
+    {
+#if defined(__x86_64__) && !defined(_WIN32)
+        std::int64_t i[6] = {};
+        double d[8] = {};
+        std::size_t integers = 0, reals = 0;
+        for (std::int64_t a = 0; a < count; a++)
+        {
+            int kind = kinds >> (a * 2) & 3;
+            if ((kind == 0 && integers == 6) || (kind != 0 && reals == 8))
+                throw std::runtime_error("the interpreter passes externs at most 6 integers and 8 floating point values");
+            if (kind == 0)
+                i[integers++] = arguments[a];
+            else
+                std::memcpy(d + reals++, arguments + a, sizeof(double));
+        }
+        std::int64_t bits = 0;
+        if (result == 0)
+            return ((mixed_function) function)(i[0], i[1], i[2], i[3], i[4], i[5], d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+        if (result == 1)
+        {
+            float f = ((float_function) function)(i[0], i[1], i[2], i[3], i[4], i[5], d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+            std::memcpy(&bits, &f, sizeof(f));
+            return bits;
+        }
+        double r = ((double_function) function)(i[0], i[1], i[2], i[3], i[4], i[5], d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+        std::memcpy(&bits, &r, sizeof(r));
+        return bits;
+#else
+        throw std::runtime_error("the interpreter only passes floating point values to externs on x86-64 system v hosts");
+#endif
+    }
+
+    // vadd, vmul, vfill and vcopy over count elements of T. integers wrap, as the
+    // native kernels' do
+    template <typename T>
+    void bulk_elements(bulk_op op, std::int64_t destination, std::int64_t source, std::int64_t count)
+    {
+        typedef std::conditional_t<std::is_floating_point_v<T>, T, std::uint64_t> wide;
+        T* dst = (T*) destination;
+        const T* src = (const T*) source;
+        T value;
+        std::memcpy(&value, &source, sizeof(T));
+        for (std::int64_t i = 0; i < count; i++)
+        {
+            switch (op)
+            {
+                case bulk_ops::ADD: dst[i] = (T) ((wide) dst[i] + (wide) src[i]); break;
+                case bulk_ops::MUL: dst[i] = (T) ((wide) dst[i] * (wide) src[i]); break;
+                case bulk_ops::FILL: dst[i] = value; break;
+                default: dst[i] = src[i]; break;
+            }
+        }
+    }
+
+    void bulk(bulk_op op, value_type type, const std::int64_t* arguments)
+    {
+        switch (type)
+        {
+            case value_types::I8: bulk_elements<std::uint8_t>(op, arguments[0], arguments[1], arguments[2]); break;
+            case value_types::I16: bulk_elements<std::uint16_t>(op, arguments[0], arguments[1], arguments[2]); break;
+            case value_types::I32: bulk_elements<std::uint32_t>(op, arguments[0], arguments[1], arguments[2]); break;
+            case value_types::F32: bulk_elements<float>(op, arguments[0], arguments[1], arguments[2]); break;
+            case value_types::F64: bulk_elements<double>(op, arguments[0], arguments[1], arguments[2]); break;
+            default: bulk_elements<std::uint64_t>(op, arguments[0], arguments[1], arguments[2]); break;
+        }
+    }
+
+    class interpreter
+    {
+    private:
+        bytecode_module& module;
+        std::vector<std::vector<cell>> threaded;
+        std::vector<void*> natives;
+        std::unique_ptr<std::int64_t[]> stack; // left uninitialised, so untouched pages cost nothing
+        std::size_t top;
+    public:
+        interpreter(bytecode_module& module);
+        bool link();
+        std::int64_t call(std::uint32_t function, const std::int64_t* arguments, std::uint32_t count);
+    };
+
+    interpreter::interpreter(bytecode_module& module) : module(module)
+    {
+        this->threaded.resize(module.functions.size());
+        this->stack = std::unique_ptr<std::int64_t[]>(new std::int64_t[STACK_WORDS]);
+        this->top = 0;
+    }
+
+    bool interpreter::link()
+    {
+        for (const std::string& e : module.externs)
+        {
+            natives.push_back(host_symbol(e));
+            if (natives.back() == nullptr)
+            {
+                arrow::err("'" + e + "' could not be found in this process");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::int64_t interpreter::call(std::uint32_t function, const std::int64_t* arguments, std::uint32_t count)
+    {
+#ifdef ARROW_THREADED
+        static const void* HANDLERS[bytecode_ops::OPS] = {
+            &&handle_CONST, &&handle_STRING, &&handle_MOVE, &&handle_LOAD, &&handle_STORE, &&handle_ADD, &&handle_ALLOC,
+            &&handle_FREE, &&handle_FRAME_ALLOC, &&handle_PARAM, &&handle_CALL, &&handle_CALL_EXTERN, &&handle_RET, &&handle_END,
+            &&handle_LOAD_I8, &&handle_LOAD_I16, &&handle_LOAD_I32, &&handle_STORE_I8, &&handle_STORE_I16, &&handle_STORE_I32,
+            &&handle_ADD_F32, &&handle_ADD_F64, &&handle_CALL_EXTERN_REAL, &&handle_BULK
+        };
+#endif
+        std::vector<cell>& code = threaded[function];
+        if (code.empty())
+        {
+            // translated on first call. strings and externs become the addresses they stand for
+            std::vector<std::uint32_t>& words = module.functions[function].code;
+            for (std::size_t i = 0; i < words.size(); i += 1 + bytecode_ops::operands(words[i]))
+            {
+                bytecode_op op = words[i] == bytecode_ops::STRING ? bytecode_ops::CONST : words[i];
+                cell c;
+#ifdef ARROW_THREADED
+                c.handler = HANDLERS[op];
+#else
+                c.value = op;
+#endif
+                code.push_back(c);
+                if (words[i] == bytecode_ops::CONST)
+                {
+                    code.push_back(operand(words[i + 1]));
+                    code.push_back(operand((std::int64_t) ((std::uint64_t) words[i + 3] << 32 | words[i + 2])));
+                    continue;
+                }
+                for (int o = 1; o <= bytecode_ops::operands(words[i]); o++)
+                    code.push_back(operand(words[i + o]));
+                if (words[i] == bytecode_ops::STRING)
+                    code.back().value = (std::int64_t) module.literals[words[i + 2]].c_str();
+                else if (words[i] == bytecode_ops::CALL_EXTERN || words[i] == bytecode_ops::CALL_EXTERN_REAL)
+                    code[code.size() - bytecode_ops::operands(words[i]) + 1].handler = natives[words[i + 2]];
+            }
+        }
+        std::size_t saved = top;
+        std::size_t base = top + ((FRAME_ALIGNMENT - (std::uintptr_t) &stack[top] % FRAME_ALIGNMENT) % FRAME_ALIGNMENT) / 8;
+        if (base + module.functions[function].frame > STACK_WORDS)
+            throw std::runtime_error("the interpreter ran out of stack");
+        std::int64_t* frame = &stack[base];
+        top = base + module.functions[function].frame;
+        std::int64_t result = 0;
+        const cell* pc = code.data();
+#ifdef ARROW_THREADED
+        NEXT;
+#endif
+        for (;;)
+        {
+#ifndef ARROW_THREADED
+            switch ((pc++)->value)
+#endif
+            {
+                CASE(CONST)
+                CASE(STRING)
+                    frame[pc[0].value] = pc[1].value;
+                    pc += 2;
+                    NEXT;
+                CASE(MOVE)
+                    frame[pc[0].value] = frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(LOAD)
+                    frame[pc[0].value] = *(std::int64_t*) frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(STORE)
+                    *(std::int64_t*) frame[pc[0].value] = frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(LOAD_I8)
+                    frame[pc[0].value] = *(std::int8_t*) frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(LOAD_I16)
+                    frame[pc[0].value] = *(std::int16_t*) frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(LOAD_I32)
+                    frame[pc[0].value] = *(std::int32_t*) frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(STORE_I8)
+                    *(std::int8_t*) frame[pc[0].value] = frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(STORE_I16)
+                    *(std::int16_t*) frame[pc[0].value] = frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(STORE_I32)
+                    *(std::int32_t*) frame[pc[0].value] = frame[pc[1].value];
+                    pc += 2;
+                    NEXT;
+                CASE(ADD)
+                    frame[pc[0].value] = frame[pc[1].value] + frame[pc[2].value];
+                    pc += 3;
+                    NEXT;
+                CASE(ALLOC)
+                    frame[pc[0].value] = allocate(frame[pc[1].value], pc[2].value);
+                    pc += 3;
+                    NEXT;
+                CASE(FREE)
+                    release(frame[pc[0].value]);
+                    pc += 1;
+                    NEXT;
+                CASE(FRAME_ALLOC)
+                    std::memset(frame + pc[1].value, 0, pc[2].value * 8);
+                    frame[pc[0].value] = (std::int64_t) (frame + pc[1].value);
+                    pc += 3;
+                    NEXT;
+                CASE(PARAM)
+                    frame[pc[0].value] = pc[1].value < count ? arguments[pc[1].value] : 0;
+                    pc += 2;
+                    NEXT;
+                CASE(CALL)
+                    frame[pc[0].value] = call(pc[1].value, frame + pc[2].value, pc[3].value);
+                    pc += 4;
+                    NEXT;
+                CASE(CALL_EXTERN)
+                {
+                    std::int64_t a[MAX_EXTERN_ARGUMENTS] = {};
+                    std::memcpy(a, frame + pc[2].value, pc[3].value * 8);
+                    frame[pc[0].value] = ((native_function) pc[1].handler)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]);
+                    pc += 4;
+                    NEXT;
+                }
+                CASE(ADD_F32)
+                {
+                    float a = 0, b = 0;
+                    std::memcpy(&a, frame + pc[1].value, sizeof(a));
+                    std::memcpy(&b, frame + pc[2].value, sizeof(b));
+                    float sum = a + b;
+                    frame[pc[0].value] = 0;
+                    std::memcpy(frame + pc[0].value, &sum, sizeof(sum));
+                    pc += 3;
+                    NEXT;
+                }
+                CASE(ADD_F64)
+                {
+                    double a = 0, b = 0;
+                    std::memcpy(&a, frame + pc[1].value, sizeof(a));
+                    std::memcpy(&b, frame + pc[2].value, sizeof(b));
+                    double sum = a + b;
+                    std::memcpy(frame + pc[0].value, &sum, sizeof(sum));
+                    pc += 3;
+                    NEXT;
+                }
+                CASE(CALL_EXTERN_REAL)
+                    frame[pc[0].value] = call_real(pc[1].handler, frame + pc[2].value, pc[3].value, pc[4].value, pc[5].value);
+                    pc += 6;
+                    NEXT;
+                CASE(BULK)
+                    bulk(pc[0].value, pc[1].value, frame + pc[2].value);
+                    pc += 3;
+                    NEXT;
+                CASE(RET)
+                    result = frame[pc[0].value];
+                    pc += 1;
+                    NEXT;
+                CASE(END)
+                    top = saved;
+                    return result;
+            }
+        }
+    }
+
+    bool interpret(bytecode_module& module, std::int64_t& result)
+    {
+        interpreter in = interpreter(module);
+        if (!in.link())
+            return false;
+        try
+        {
+            result = in.call(module.entry, nullptr, 0);
+        }
+        catch (std::runtime_error& e)
+        {
+            arrow::err(e.what());
+            return false;
+        }
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef ARROW_INTERPRETER_H
+#define ARROW_INTERPRETER_H
+
+#include <cstdint>
+
+#include "bytecode.h"
+
+namespace arrow
+{
+    // runs a compiled program on a direct threaded interpreter, calling def externals
+    // natively, and gives back what its entry returned. false after reporting an error
+    bool interpret(bytecode_module& module, std::int64_t& result);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "ir.h"
+
+namespace arrow
+{
+    namespace value_types
+    {
+        std::string name(value_type vt)
+        {
+            switch (vt)
+            {
+                case VOID: return "void";
+                case I8: return "i8";
+                case I16: return "i16";
+                case I32: return "i32";
+                case I64: return "i64";
+                case PTR: return "ptr";
+                case F32: return "f32";
+                case F64: return "f64";
+                default: return "UNKNOWN_VALUE_TYPE_" + std::to_string(vt);
+            }
+        }
+
+        int size(value_type vt)
+        {
+            switch (vt)
+            {
+                case I8: return 1;
+                case I16: return 2;
+                case I32: return 4;
+                case F32: return 4;
+                case VOID: return 0;
+                default: return 8;
+            }
+        }
+
+        bool floating(value_type vt)
+        {
+            return vt == F32 || vt == F64;
+        }
+    }
+
+    namespace ir_ops
+    {
+        std::string name(ir_op op)
+        {
+            switch (op)
+            {
+                case CONST: return "const";
+                case STRING: return "string";
+                case LOAD_SLOT: return "load_slot";
+                case STORE_SLOT: return "store_slot";
+                case LOAD: return "load";
+                case STORE: return "store";
+                case ADD: return "add";
+                case ALLOC: return "alloc";
+                case FREE: return "free";
+                case PARAM: return "param";
+                case ARG: return "arg";
+                case CALL: return "call";
+                case RET: return "ret";
+                case ASM: return "asm";
+                case FRAME_ALLOC: return "frame_alloc";
+                case BULK: return "bulk";
+                default: return "UNKNOWN_IR_OP_" + std::to_string(op);
+            }
+        }
+
+        bool defines(ir_op op)
+        {
+            return op == CONST || op == STRING || op == LOAD_SLOT || op == LOAD || op == ADD || op == PARAM || op == CALL;
+        }
+
+        bool reads_a(ir_op op)
+        {
+            return op == STORE_SLOT || op == LOAD || op == STORE || op == ADD || op == ALLOC || op == ARG || op == RET || op == FRAME_ALLOC;
+        }
+
+        bool reads_b(ir_op op)
+        {
+            return op == STORE || op == ADD || op == ALLOC || op == FRAME_ALLOC;
+        }
+
+        bool clobbers(ir_op op)
+        {
+            return op == CALL || op == ALLOC || op == FREE || op == ASM || op == BULK;
+        }
+    }
+
+    namespace bulk_ops
+    {
+        std::string name(bulk_op op)
+        {
+            switch (op)
+            {
+                case ADD: return "vadd";
+                case MUL: return "vmul";
+                case FILL: return "vfill";
+                case COPY: return "vcopy";
+                default: return "UNKNOWN_BULK_OP_" + std::to_string(op);
+            }
+        }
+    }
+
+    ir_function::ir_function(std::string name, int parent)
+    {
+        this->name = name;
+        this->parent = parent;
+        this->params = 0;
+        blocks.emplace_back();
+    }
+
+    ir_block& ir_function::block()
+    {
+        return blocks.back();
+    }
+
+    ir_block& ir_function::open_block()
+    {
+        return blocks.emplace_back();
+    }
+
+    std::uint32_t ir_function::value(value_type type)
+    {
+        values.push_back(type);
+        return values.size() - 1;
+    }
+
+    int ir_function::slot(value_type type, std::string name)
+    {
+        slots.push_back({ type, name });
+        return slots.size() - 1;
+    }
+
+    std::uint32_t ir_function::emit(ir_op op, value_type type, std::uint32_t a, std::uint32_t b, std::int64_t imm, int line)
+    {
+        std::uint32_t dst = ir_ops::defines(op) ? value(type) : NO_VALUE;
+        block().nodes.push_back({ op, type, dst, a, b, imm, line });
+        return dst;
+    }
+
+    int ir_module::function(std::string name, int parent)
+    {
+        functions.emplace_back(name, parent);
+        function_index.emplace(name, functions.size() - 1); // the first of a name is the one found
+        return functions.size() - 1;
+    }
+
+    int ir_module::function(ir_function fn)
+    {
+        functions.push_back(std::move(fn));
+        function_index.emplace(functions.back().name, functions.size() - 1);
+        return functions.size() - 1;
+    }
+
+    int ir_module::find_function(const std::string& name)
+    {
+        auto it = function_index.find(name);
+        return it != function_index.end() ? it->second : -1;
+    }
+
+    int ir_module::name(std::string_view name)
+    {
+        auto it = name_index.find(name);
+        if (it != name_index.end())
+            return it->second;
+        names.emplace_back(name);
+        name_index.emplace(std::string(name), names.size() - 1);
+        return names.size() - 1;
+    }
+
+    int ir_module::literal(std::string_view content)
+    {
+        auto it = literal_index.find(content);
+        if (it != literal_index.end())
+            return it->second;
+        literals.emplace_back(content);
+        literal_index.emplace(std::string(content), literals.size() - 1);
+        return literals.size() - 1;
+    }
+
+    std::string value_name(std::uint32_t v)
+    {
+        return v == NO_VALUE ? "_" : '%' + std::to_string(v);
+    }
+
+    std::string ir_module::dump()
+    {
+        std::string str;
+        for (auto& e : externs)
+            str += "extern " + e + '\n';
+        for (std::size_t i = 0; i < literals.size(); i++)
+            str += "literal " + std::to_string(i) + ' ' + literals[i] + '\n';
+        for (ir_function& fn : functions)
+        {
+            str += "label " + fn.name;
+            if (fn.parent != -1)
+                str += " in " + functions[fn.parent].name;
+            str += '\n';
+            for (std::size_t i = 0; i < fn.slots.size(); i++)
+                str += "  slot $" + std::to_string(i) + ':' + value_types::name(fn.slots[i].type) + ' ' + fn.slots[i].name + '\n';
+            for (std::size_t b = 0; b < fn.blocks.size(); b++)
+            {
+                str += "  block " + std::to_string(b) + '\n';
+                for (ir_node& n : fn.blocks[b].nodes)
+                {
+                    str += "    ";
+                    if (n.dst != NO_VALUE)
+                        str += value_name(n.dst) + ':' + value_types::name(n.type) + " = ";
+                    str += ir_ops::name(n.op);
+                    switch (n.op)
+                    {
+                        case ir_ops::CONST: str += ' ' + std::to_string(n.imm); break;
+                        case ir_ops::STRING: str += " literal " + std::to_string(n.imm); break;
+                        case ir_ops::LOAD_SLOT:
+                        case ir_ops::FREE: str += " $" + std::to_string(n.imm); break;
+                        case ir_ops::STORE_SLOT: str += " $" + std::to_string(n.imm) + ", " + value_name(n.a); break;
+                        case ir_ops::ALLOC:
+                        case ir_ops::FRAME_ALLOC:
+                        {
+                            str += " $" + std::to_string(n.imm) + ", " + value_name(n.a);
+                            if (n.b != NO_VALUE)
+                                str += ", align " + value_name(n.b);
+                            break;
+                        }
+                        case ir_ops::LOAD:
+                        case ir_ops::RET: str += ' ' + value_name(n.a); break;
+                        case ir_ops::STORE:
+                        case ir_ops::ADD: str += ' ' + value_name(n.a) + ", " + value_name(n.b); break;
+                        case ir_ops::PARAM: str += ' ' + std::to_string(n.imm); break;
+                        case ir_ops::ARG: str += ' ' + std::to_string(n.imm) + ", " + value_name(n.a); break;
+                        case ir_ops::CALL: str += ' ' + names[n.imm] + ", " + std::to_string(n.a); break;
+                        case ir_ops::BULK: str += ' ' + bulk_ops::name(n.imm) + ' ' + value_types::name(n.type) + ", " + std::to_string(n.a); break;
+                        case ir_ops::ASM: str += " \"" + names[n.imm] + '"'; break;
+                    }
+                    str += '\n';
+                }
+            }
+        }
+        return str;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef ARROW_IR_H
+#define ARROW_IR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace arrow
+{
+    typedef unsigned int value_type;
+    namespace value_types
+    {
+        const value_type VOID = 0x00;
+        const value_type I8 = 0x01;
+        const value_type I16 = 0x02;
+        const value_type I32 = 0x03;
+        const value_type I64 = 0x04;
+        const value_type PTR = 0x05;
+        const value_type F32 = 0x06;
+        const value_type F64 = 0x07;
+
+        std::string name(value_type vt);
+        int size(value_type vt);
+        bool floating(value_type vt); // float and double, which live in memory and registers as their bits
+    }
+
+    // operands of each node, by op. values are virtual registers, slots are the frame
+    // slots holding the pointer of each reference
+    typedef unsigned int ir_op;
+    namespace ir_ops
+    {
+        const ir_op CONST = 0x00; // dst = imm
+        const ir_op STRING = 0x01; // dst = address of string literal imm
+        const ir_op LOAD_SLOT = 0x02; // dst = slot imm
+        const ir_op STORE_SLOT = 0x03; // slot imm = a
+        const ir_op LOAD = 0x04; // dst = [a]
+        const ir_op STORE = 0x05; // [a] = b
+        const ir_op ADD = 0x06; // dst = a + b
+        const ir_op ALLOC = 0x07; // slot imm = allocation of a bytes, aligned to constant b when b is a value
+        const ir_op FREE = 0x08; // release the allocation in slot imm
+        const ir_op PARAM = 0x09; // dst = incoming argument imm
+        const ir_op ARG = 0x0A; // outgoing argument imm of the next call = a
+        const ir_op CALL = 0x0B; // dst = call to name imm with a arguments
+        const ir_op RET = 0x0C; // return value of the label = a
+        const ir_op ASM = 0x0D; // inline assembly name imm
+        const ir_op FRAME_ALLOC = 0x0E; // slot imm = a bytes in the label's own frame, aligned to constant b when b is a value
+        const ir_op BULK = 0x0F; // bulk operation imm over type elements, given the last a arguments
+
+        std::string name(ir_op op);
+        bool defines(ir_op op); // whether nodes of this op produce a value
+        bool reads_a(ir_op op); // whether a holds a value operand
+        bool reads_b(ir_op op);
+        bool clobbers(ir_op op); // whether nodes of this op destroy every volatile register
+    }
+
+    // operations over whole buffers. their arguments are the destination, the source
+    // or the value to fill with, and how many elements to go over
+    typedef unsigned int bulk_op;
+    namespace bulk_ops
+    {
+        const bulk_op ADD = 0x00; // dst[i] += src[i]
+        const bulk_op MUL = 0x01; // dst[i] *= src[i]
+        const bulk_op FILL = 0x02; // dst[i] = value
+        const bulk_op COPY = 0x03; // dst[i] = src[i], for buffers that do not overlap
+
+        std::string name(bulk_op op);
+    }
+
+    const std::uint32_t NO_VALUE = UINT32_MAX;
+
+    typedef struct ir_node {
+        ir_op op;
+        value_type type;
+        std::uint32_t dst;
+        std::uint32_t a;
+        std::uint32_t b;
+        std::int64_t imm;
+        int line;
+    } ir_node;
+
+    typedef struct ir_slot {
+        value_type type;
+        std::string name;
+    } ir_slot;
+
+    typedef struct ir_block {
+        std::vector<ir_node> nodes;
+    } ir_block;
+
+    class ir_function
+    {
+    public:
+        std::string name;
+        int parent; // function of the enclosing label, -1 at the top level
+        std::vector<ir_block> blocks;
+        std::vector<value_type> values; // type of each virtual register
+        std::vector<ir_slot> slots;
+        int params; // number of pulls so far
+
+        ir_function(std::string name, int parent);
+        ir_block& block(); // the block currently being appended to
+        ir_block& open_block();
+        std::uint32_t value(value_type type);
+        int slot(value_type type, std::string name);
+        std::uint32_t emit(ir_op op, value_type type, std::uint32_t a, std::uint32_t b, std::int64_t imm, int line);
+    };
+
+    // a whole program. functions, their blocks and nodes live in contiguous arrays
+    // owned by the module and refer to each other by index, names and literals are
+    // pooled the same way
+    class ir_module
+    {
+    private:
+        std::map<std::string, int, std::less<>> name_index;
+        std::unordered_map<std::string, int> function_index;
+        std::map<std::string, int, std::less<>> literal_index;
+    public:
+        std::vector<ir_function> functions;
+        std::vector<std::string> names;
+        std::vector<std::string> literals;
+        std::set<std::string> externs;
+
+        int function(std::string name, int parent);
+        int function(ir_function fn); // adds a label made elsewhere, such as a copy of another
+        int find_function(const std::string& name);
+        int name(std::string_view name);
+        int literal(std::string_view content); // the same index for the same content
+        std::string dump();
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,148 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__x86_64__)
+#define ARROW_JIT
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+
+#include "jit.h"
+#include "logger.h"
+
+namespace arrow
+{
+    void* host_symbol(const std::string& name)
+    {
+#ifdef _WIN32
+        // the program itself, then the c runtimes and kernel32 that def'd functions come from
+        const char* MODULES[] = { nullptr, "ucrtbase.dll", "msvcrt.dll", "kernel32.dll" };
+        for (const char* module : MODULES)
+        {
+            HMODULE handle = module == nullptr ? GetModuleHandleA(nullptr) : LoadLibraryA(module);
+            FARPROC address = handle != nullptr ? GetProcAddress(handle, name.c_str()) : nullptr;
+            if (address != nullptr)
+                return (void*) address;
+        }
+        return nullptr;
+#else
+        return dlsym(RTLD_DEFAULT, name.c_str());
+#endif
+    }
+
+#ifdef ARROW_JIT
+    // jmp qword [rip], followed by the address it jumps to
+    const unsigned char STUB[] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+    const std::uint64_t STUB_SIZE = 16;
+
+    std::uint64_t align_up(std::uint64_t n, std::uint64_t alignment)
+    {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    jit_entry jit(elf_object& object, const std::string& entry)
+    {
+        encoder& text = object.text;
+        text.resolve();
+        auto start = text.labels.find(entry);
+        if (start == text.labels.end())
+        {
+            arrow::err("no entry point '" + entry + "' to run");
+            return nullptr;
+        }
+        std::map<std::string, void*> externals;
+        for (fixup& f : text.fixups)
+        {
+            if (text.labels.count(f.symbol) != 0 || object.symbols.count(f.symbol) != 0 || externals.count(f.symbol) != 0)
+                continue;
+            void* address = object.externals.count(f.symbol) != 0 ? host_symbol(f.symbol) : nullptr;
+            if (address == nullptr)
+            {
+                arrow::err("'" + f.symbol + "' could not be found in this process");
+                return nullptr;
+            }
+            externals[f.symbol] = address;
+        }
+        // code and the stubs externals are called through, as libraries can be loaded
+        // further away than a call reaches, then read-only data, and data and bss, on
+        // their own pages
+        std::uint64_t page = sysconf(_SC_PAGESIZE);
+        std::uint64_t stubs = align_up(text.code.size(), STUB_SIZE);
+        std::uint64_t rodata = align_up(stubs + externals.size() * STUB_SIZE, page);
+        std::uint64_t data = align_up(rodata + object.rodata.size(), page);
+        std::uint64_t bss = align_up(data + object.data.size(), std::max(page, object.bss_alignment));
+        std::uint64_t size = align_up(bss + object.bss, page);
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            arrow::err("could not map " + std::to_string(size) + " bytes to run the program in");
+            return nullptr;
+        }
+        unsigned char* base = (unsigned char*) memory;
+        std::memcpy(base, text.code.data(), text.code.size());
+        std::memcpy(base + rodata, object.rodata.data(), object.rodata.size());
+        std::memcpy(base + data, object.data.data(), object.data.size());
+        std::map<std::string, std::uint64_t> stub_offsets;
+        for (auto& [name, address] : externals)
+        {
+            std::memcpy(base + stubs, STUB, sizeof(STUB));
+            std::memcpy(base + stubs + sizeof(STUB), &address, sizeof(address));
+            stub_offsets[name] = stubs;
+            stubs += STUB_SIZE;
+        }
+        for (fixup& f : text.fixups)
+        {
+            std::uint64_t target = 0;
+            auto label = text.labels.find(f.symbol);
+            auto symbol = object.symbols.find(f.symbol);
+            if (label != text.labels.end())
+                target = (std::uint64_t) base + label->second;
+            else if (symbol != object.symbols.end())
+            {
+                std::uint64_t section = symbol->second.first == elf_sections::DATA ? data : symbol->second.first == elf_sections::RODATA ? rodata : bss;
+                target = (std::uint64_t) base + section + symbol->second.second;
+            }
+            else if (f.kind == fixup_kinds::BRANCH)
+                target = (std::uint64_t) base + stub_offsets[f.symbol];
+            else if (f.kind == fixup_kinds::ABSOLUTE)
+                target = (std::uint64_t) externals[f.symbol];
+            else
+            {
+                arrow::err("'" + f.symbol + "' is data of another library, which the program cannot reach");
+                munmap(memory, size);
+                return nullptr;
+            }
+            if (f.kind == fixup_kinds::ABSOLUTE)
+            {
+                std::uint64_t address = target + f.addend;
+                std::memcpy(base + f.offset, &address, sizeof(address));
+                continue;
+            }
+            std::int32_t distance = target + f.addend - ((std::uint64_t) base + f.offset);
+            std::memcpy(base + f.offset, &distance, sizeof(distance));
+        }
+        if (mprotect(memory, rodata, PROT_READ | PROT_EXEC) != 0 || mprotect(base + rodata, data - rodata, PROT_READ) != 0)
+        {
+            arrow::err("could not make the program executable");
+            munmap(memory, size);
+            return nullptr;
+        }
+        return (jit_entry) (base + start->second);
+    }
+#else
+    jit_entry jit(elf_object& object, const std::string& entry)
+    {
+        arrow::err("running programs in process needs an x86-64 linux host");
+        return nullptr;
+    }
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef ARROW_JIT_H
+#define ARROW_JIT_H
+
+#include <string>
+
+#include "elf.h"
+
+namespace arrow
+{
+    typedef int (*jit_entry)();
+
+    // the address of a function already loaded into this process, nullptr when
+    // there is none by that name
+    void* host_symbol(const std::string& name);
+
+    // places an encoded program in executable memory of this process, resolving
+    // def externals against the libraries already loaded into it, and returns its
+    // entry. nullptr after reporting an error, or on hosts other than x86-64 linux
+    jit_entry jit(elf_object& object, const std::string& entry);
+}
+
+#endif
\ No newline at end of file
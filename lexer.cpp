@@ -0,0 +1,457 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ARROW_LEXER_SIMD
+#include <immintrin.h>
+#endif
+
+#include "lexer.h"
+
+namespace arrow
+{
+    namespace lex_modes
+    {
+        std::string name(lex_mode mode)
+        {
+            switch (mode)
+            {
+                case AUTO: return "AUTO";
+                case SCALAR: return "SCALAR";
+                case SSE2: return "SSE2";
+                case AVX2: return "AVX2";
+                default: return "UNKNOWN_LEX_MODE_" + std::to_string(mode);
+            }
+        }
+
+        lex_mode parse(std::string_view name)
+        {
+            if (name == "scalar") return SCALAR;
+            if (name == "sse2") return SSE2;
+            if (name == "avx2") return AVX2;
+            return AUTO;
+        }
+
+        bool supported(lex_mode mode)
+        {
+            switch (mode)
+            {
+                case AUTO:
+                case SCALAR:
+                    return true;
+#ifdef ARROW_LEXER_SIMD
+                case SSE2: return __builtin_cpu_supports("sse2");
+                case AVX2: return __builtin_cpu_supports("avx2");
+#endif
+                default: return false;
+            }
+        }
+
+        lex_mode resolve(lex_mode mode)
+        {
+            if (mode != AUTO && supported(mode))
+                return mode;
+            if (supported(AVX2))
+                return AVX2;
+            if (supported(SSE2))
+                return SSE2;
+            return SCALAR;
+        }
+    }
+
+    source::source(const std::string& path)
+    {
+        data = nullptr;
+        length = 0;
+        opened = false;
+        file = nullptr;
+        mapping = nullptr;
+#ifdef _WIN32
+        HANDLE fh = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (fh == INVALID_HANDLE_VALUE)
+            return;
+        file = fh;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(fh, &size))
+            return;
+        opened = true;
+        if (size.QuadPart == 0)
+            return;
+        HANDLE mh = CreateFileMappingA(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mh == nullptr)
+        {
+            opened = false;
+            return;
+        }
+        mapping = mh;
+        data = (const char*) MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr)
+        {
+            opened = false;
+            return;
+        }
+        length = (std::size_t) size.QuadPart;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            return;
+        }
+        opened = true;
+        if (st.st_size != 0)
+        {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+                opened = false;
+            else
+            {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                data = (const char*) p;
+                length = st.st_size;
+            }
+        }
+        close(fd); // the mapping keeps its own reference to the file
+#endif
+    }
+
+    bool source::good()
+    {
+        return opened;
+    }
+
+    std::string_view source::view()
+    {
+        return std::string_view(data, length);
+    }
+
+    source::~source()
+    {
+#ifdef _WIN32
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+        if (mapping != nullptr)
+            CloseHandle((HANDLE) mapping);
+        if (file != nullptr)
+            CloseHandle((HANDLE) file);
+#else
+        if (data != nullptr)
+            munmap((void*) data, length);
+#endif
+    }
+
+    bool is_whitespace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    std::vector<token> lex_scalar(std::string_view src)
+    {
+        std::vector<token> tokens;
+        tokens.reserve(src.length() / 4);
+        const char* s = src.data();
+        std::size_t n = src.length();
+        int line = 1;
+        for (std::size_t i = 0; i < n;)
+        {
+            char c = s[i];
+            if (c == '\n')
+            {
+                line++;
+                i++;
+                continue;
+            }
+            if (is_whitespace(c))
+            {
+                i++;
+                continue;
+            }
+            if (c == '#') // comments run to the end of the line
+            {
+                while (i < n && s[i] != '\n')
+                    i++;
+                continue;
+            }
+            if (opcode op = punctuator(c))
+            {
+                tokens.push_back({ src.substr(i, 1), token_types::PUNCTUATOR, op, line });
+                i++;
+                continue;
+            }
+            // a lexeme runs until whitespace, a comment or a punctuator, none of which
+            // count while inside a string literal
+            std::size_t start = i;
+            int start_line = line;
+            bool in_string_literal = false;
+            for (; i < n; i++)
+            {
+                char d = s[i];
+                if (d == '"' && (i == start || s[i - 1] != '\\'))
+                    in_string_literal = !in_string_literal;
+                else if (in_string_literal)
+                {
+                    if (d == '\n')
+                        line++;
+                }
+                else if (is_whitespace(d) || d == '#' || is_punctuator(d))
+                    break;
+            }
+            std::string_view lexeme = src.substr(start, i - start);
+            opcode op;
+            token_type type = classify(lexeme, op);
+            tokens.push_back({ lexeme, type, op, start_line });
+        }
+        return tokens;
+    }
+
+#ifdef ARROW_LEXER_SIMD
+    // one bit per byte of a 64 byte block of the source
+    struct block_masks
+    {
+        std::uint64_t whitespace;
+        std::uint64_t newline;
+        std::uint64_t quote;
+        std::uint64_t comment;
+        std::uint64_t punctuator;
+        std::uint64_t boundary; // anything that can end a lexeme outside of a string literal
+    };
+
+    typedef void (*block_classifier)(const char* p, block_masks& m);
+
+    // the character sets below mirror is_whitespace(), '"', '#' and the punctuators in KEYWORDS
+
+    __attribute__((target("sse2")))
+    void classify_sse2(const char* p, block_masks& m)
+    {
+        m = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) (p + i * 16));
+            __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+            __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), nl));
+            __m128i qt = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+            __m128i cm = _mm_cmpeq_epi8(v, _mm_set1_epi8('#'));
+            __m128i pn = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')), _mm_cmpeq_epi8(v, _mm_set1_epi8('*'))),
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8(';'))));
+            int shift = i * 16;
+            m.whitespace |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(ws) << shift;
+            m.newline |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(nl) << shift;
+            m.quote |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(qt) << shift;
+            m.comment |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(cm) << shift;
+            m.punctuator |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(pn) << shift;
+        }
+        m.boundary = m.whitespace | m.quote | m.comment | m.punctuator;
+    }
+
+    // classes for the nibble lookup. a byte belongs to a class when the bit is set
+    // in both the entry for its low nibble and the entry for its high nibble
+    const unsigned char NIBBLE_SPACE = 0x01; // ' '
+    const unsigned char NIBBLE_CONTROL = 0x02; // '\t', '\r', '\n'
+    const unsigned char NIBBLE_NEWLINE = 0x04;
+    const unsigned char NIBBLE_QUOTE = 0x08;
+    const unsigned char NIBBLE_COMMENT = 0x10;
+    const unsigned char NIBBLE_PUNCTUATOR_2 = 0x20; // ',', '*'
+    const unsigned char NIBBLE_PUNCTUATOR_3 = 0x40; // ';'
+    const unsigned char NIBBLE_PUNCTUATOR_7 = 0x80; // '{', '}'
+
+    __attribute__((target("avx2")))
+    inline std::uint64_t class_bits_avx2(__m256i cls, unsigned char bits)
+    {
+        __m256i none = _mm256_cmpeq_epi8(_mm256_and_si256(cls, _mm256_set1_epi8((char) bits)), _mm256_setzero_si256());
+        return (std::uint64_t) (std::uint32_t) ~_mm256_movemask_epi8(none);
+    }
+
+    __attribute__((target("avx2")))
+    void classify_avx2(const char* p, block_masks& m)
+    {
+        const __m256i lo_table = _mm256_setr_epi8(
+            NIBBLE_SPACE, 0, NIBBLE_QUOTE, NIBBLE_COMMENT, 0, 0, 0, 0,
+            0, NIBBLE_CONTROL, NIBBLE_CONTROL | NIBBLE_NEWLINE | NIBBLE_PUNCTUATOR_2, NIBBLE_PUNCTUATOR_3 | NIBBLE_PUNCTUATOR_7,
+            NIBBLE_PUNCTUATOR_2, NIBBLE_CONTROL | NIBBLE_PUNCTUATOR_7, 0, 0,
+            NIBBLE_SPACE, 0, NIBBLE_QUOTE, NIBBLE_COMMENT, 0, 0, 0, 0,
+            0, NIBBLE_CONTROL, NIBBLE_CONTROL | NIBBLE_NEWLINE | NIBBLE_PUNCTUATOR_2, NIBBLE_PUNCTUATOR_3 | NIBBLE_PUNCTUATOR_7,
+            NIBBLE_PUNCTUATOR_2, NIBBLE_CONTROL | NIBBLE_PUNCTUATOR_7, 0, 0);
+        const __m256i hi_table = _mm256_setr_epi8(
+            NIBBLE_CONTROL | NIBBLE_NEWLINE, 0, NIBBLE_SPACE | NIBBLE_QUOTE | NIBBLE_COMMENT | NIBBLE_PUNCTUATOR_2, NIBBLE_PUNCTUATOR_3,
+            0, 0, 0, (char) NIBBLE_PUNCTUATOR_7, 0, 0, 0, 0, 0, 0, 0, 0,
+            NIBBLE_CONTROL | NIBBLE_NEWLINE, 0, NIBBLE_SPACE | NIBBLE_QUOTE | NIBBLE_COMMENT | NIBBLE_PUNCTUATOR_2, NIBBLE_PUNCTUATOR_3,
+            0, 0, 0, (char) NIBBLE_PUNCTUATOR_7, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+        m = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 2; i++)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (p + i * 32));
+            __m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, low_nibble));
+            __m256i hi = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+            __m256i cls = _mm256_and_si256(lo, hi);
+            int shift = i * 32;
+            m.whitespace |= class_bits_avx2(cls, NIBBLE_SPACE | NIBBLE_CONTROL) << shift;
+            m.newline |= class_bits_avx2(cls, NIBBLE_NEWLINE) << shift;
+            m.quote |= class_bits_avx2(cls, NIBBLE_QUOTE) << shift;
+            m.comment |= class_bits_avx2(cls, NIBBLE_COMMENT) << shift;
+            m.punctuator |= class_bits_avx2(cls, NIBBLE_PUNCTUATOR_2 | NIBBLE_PUNCTUATOR_3 | NIBBLE_PUNCTUATOR_7) << shift;
+        }
+        m.boundary = m.whitespace | m.quote | m.comment | m.punctuator;
+    }
+
+    // walks the masks of the source one block at a time, classifying each block once
+    class block_scanner
+    {
+    private:
+        const char* s;
+        std::size_t n;
+        block_classifier classify_block;
+        std::size_t loaded;
+        block_masks m;
+        char tail[64];
+
+        const block_masks& at(std::size_t block)
+        {
+            if (block == loaded)
+                return m;
+            loaded = block;
+            std::size_t base = block * 64;
+            if (base + 64 <= n)
+                classify_block(s + base, m);
+            else
+            {
+                // the bytes past the end read as zero, which belongs to no class
+                std::memset(tail, 0, sizeof(tail));
+                std::memcpy(tail, s + base, n - base);
+                classify_block(tail, m);
+            }
+            return m;
+        }
+    public:
+        block_scanner(std::string_view src, block_classifier classify_block)
+        {
+            s = src.data();
+            n = src.length();
+            this->classify_block = classify_block;
+            loaded = SIZE_MAX;
+        }
+
+        // position of the first byte at or after pos in (or, inverted, not in) the class
+        std::size_t find(std::size_t pos, std::uint64_t block_masks::* cls, bool invert = false)
+        {
+            while (pos < n)
+            {
+                std::size_t base = pos & ~(std::size_t) 63;
+                std::uint64_t bits = at(base / 64).*cls;
+                if (invert)
+                    bits = ~bits;
+                bits &= ~0ULL << (pos - base);
+                if (bits != 0)
+                {
+                    std::size_t r = base + __builtin_ctzll(bits);
+                    return r < n ? r : n;
+                }
+                pos = base + 64;
+            }
+            return n;
+        }
+
+        int count_newlines(std::size_t from, std::size_t to)
+        {
+            int count = 0;
+            while (from < to)
+            {
+                std::size_t base = from & ~(std::size_t) 63;
+                std::size_t hi = to - base < 64 ? to - base : 64;
+                std::uint64_t range = (hi == 64 ? ~0ULL : (1ULL << hi) - 1) & (~0ULL << (from - base));
+                count += __builtin_popcountll(at(base / 64).newline & range);
+                from = base + 64;
+            }
+            return count;
+        }
+    };
+
+    std::vector<token> lex_blocks(std::string_view src, block_classifier classify_block)
+    {
+        std::vector<token> tokens;
+        tokens.reserve(src.length() / 4);
+        block_scanner scanner = block_scanner(src, classify_block);
+        const char* s = src.data();
+        std::size_t n = src.length();
+        int line = 1;
+        for (std::size_t i = 0; i < n;)
+        {
+            char c = s[i];
+            if (is_whitespace(c))
+            {
+                std::size_t j = scanner.find(i, &block_masks::whitespace, true);
+                line += scanner.count_newlines(i, j);
+                i = j;
+                continue;
+            }
+            if (c == '#')
+            {
+                i = scanner.find(i, &block_masks::newline);
+                continue;
+            }
+            if (opcode op = punctuator(c))
+            {
+                tokens.push_back({ src.substr(i, 1), token_types::PUNCTUATOR, op, line });
+                i++;
+                continue;
+            }
+            std::size_t start = i;
+            int start_line = line;
+            bool in_string_literal = false;
+            while (i < n)
+            {
+                if (in_string_literal)
+                {
+                    std::size_t q = scanner.find(i, &block_masks::quote);
+                    line += scanner.count_newlines(i, q);
+                    i = q;
+                    if (i >= n)
+                        break;
+                    if (s[i - 1] != '\\')
+                        in_string_literal = false;
+                    i++;
+                    continue;
+                }
+                i = scanner.find(i, &block_masks::boundary);
+                if (i >= n || s[i] != '"')
+                    break;
+                if (i == start || s[i - 1] != '\\')
+                    in_string_literal = true;
+                i++;
+            }
+            std::string_view lexeme = src.substr(start, i - start);
+            opcode op;
+            token_type type = classify(lexeme, op);
+            tokens.push_back({ lexeme, type, op, start_line });
+        }
+        return tokens;
+    }
+#endif
+
+    std::vector<token> lex(std::string_view src, lex_mode mode)
+    {
+#ifdef ARROW_LEXER_SIMD
+        switch (lex_modes::resolve(mode))
+        {
+            case lex_modes::AVX2: return lex_blocks(src, classify_avx2);
+            case lex_modes::SSE2: return lex_blocks(src, classify_sse2);
+        }
+#endif
+        return lex_scalar(src);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef ARROW_LEXER_H
+#define ARROW_LEXER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tokenization.h"
+
+namespace arrow
+{
+    typedef unsigned int lex_mode;
+    namespace lex_modes
+    {
+        const lex_mode AUTO = 0x00; // best mode the running cpu supports
+        const lex_mode SCALAR = 0x01;
+        const lex_mode SSE2 = 0x02;
+        const lex_mode AVX2 = 0x03;
+
+        std::string name(lex_mode mode);
+        lex_mode parse(std::string_view name); // returns AUTO for unknown names
+        bool supported(lex_mode mode);
+        lex_mode resolve(lex_mode mode); // maps AUTO and unsupported modes to the best available one
+    }
+
+    // read-only memory mapping of an input file. tokens produced by lex() point into
+    // this mapping, so it has to outlive every token taken from it
+    class source
+    {
+    private:
+        const char* data;
+        std::size_t length;
+        bool opened;
+        void* file;
+        void* mapping;
+    public:
+        source(const std::string& path);
+        source(const source&) = delete;
+        source& operator=(const source&) = delete;
+        bool good();
+        std::string_view view();
+        ~source();
+    };
+
+    // every mode produces exactly the same tokens, the simd modes just find the
+    // boundaries between them 64 bytes at a time
+    std::vector<token> lex(std::string_view src, lex_mode mode = lex_modes::AUTO);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1180 @@
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+
+#include "lower.h"
+#include "logger.h"
+#include "runtime.h"
+
+namespace arrow
+{
+    namespace operating_systems
+    {
+        std::string name(operating_system os)
+        {
+            switch (os)
+            {
+                case WINDOWS: return "WINDOWS";
+                case MAC: return "MAC";
+                case LINUX: return "LINUX";
+                default: return "UNKNOWN_OS_" + std::to_string(os);
+            }
+        }
+
+        operating_system parse(std::string_view name)
+        {
+            if (name == "windows") return WINDOWS;
+            if (name == "mac") return MAC;
+            if (name == "linux") return LINUX;
+            return UNKNOWN;
+        }
+    }
+
+    // registers values can stay in from one node to the next. they are all volatile,
+    // so values live across anything that calls out are kept in the frame instead,
+    // and SCRATCH_RESERVE of them are always left free for the nodes themselves
+    const std::array<const char*, 7> VALUE_REGISTERS = { "rax", "r10", "r11", "rcx", "rdx", "r8", "r9" };
+    const int SCRATCH_RESERVE = 2;
+    const int RED_ZONE = 128; // bytes below rsp a sysv leaf may use without reserving them
+    // registers a callee has to give back unchanged. with the allocator on, reference
+    // slots and values living across calls are kept in them, and a function saves the
+    // ones it takes in its own frame. rsi and rdi are only preserved on windows
+    const std::array<const char*, 7> SAVED_REGISTERS = { "rbx", "r12", "r13", "r14", "r15", "rsi", "rdi" };
+    const int SHADOW_SPACE = 32; // windows only
+    // registers arguments are passed in between labels, which nothing outside the
+    // program calls: more of them than the abi has, no shadow space and nothing
+    // written back to the frame on entry. rsi and rdi stay out on windows, where
+    // callers expect them kept
+    const std::vector<std::string> WINDOWS_INTERNAL_REGISTERS = { "rcx", "rdx", "r8", "r9", "r10", "r11" };
+    const std::vector<std::string> SYSV_INTERNAL_REGISTERS = { "rdi", "rsi", "rdx", "rcx", "r8", "r9", "r10", "r11" };
+    // how many parameters may wait in value registers until they are pulled, leaving
+    // the nodes before the pulls some to work with
+    const int DIRECT_PARAMS = VALUE_REGISTERS.size() - SCRATCH_RESERVE - 1;
+    const std::uint32_t PINNED = NO_VALUE - 1; // holds a register a parameter is waiting in
+
+    int align16(int bytes)
+    {
+        return (bytes + 15) & ~15;
+    }
+
+    // vector registers system v passes floating point arguments in
+    const std::size_t VECTOR_ARGUMENTS = 8;
+
+    // the data label a floating point constant is loaded from, named by its bits
+    std::string real_label(std::int64_t bits)
+    {
+        static const char DIGITS[] = "0123456789abcdef";
+        std::string label = "F";
+        for (int shift = 60; shift >= 0; shift -= 4)
+            label += DIGITS[(std::uint64_t) bits >> shift & 0xF];
+        return label;
+    }
+
+    int register_index(const std::string& name)
+    {
+        for (std::size_t i = 0; i < VALUE_REGISTERS.size(); i++)
+        {
+            if (name == VALUE_REGISTERS[i])
+                return i;
+        }
+        return -1;
+    }
+
+    // where a value lives between the node defining it and its last use
+    typedef struct value_location {
+        int reg; // index into VALUE_REGISTERS, -1 when not in a register
+        int saved; // index into SAVED_REGISTERS, -1 when not in one
+        int offset; // frame offset of its spill slot, 0 when not spilled
+        bool constant; // never stored anywhere, its text is used directly
+        bool small; // constant that fits a sign extended 32-bit immediate
+        std::string immediate;
+        int block; // frame offset of the frame allocated block the value points to, 0 otherwise
+    } value_location;
+
+    // the span of nodes a reference slot or a value has to survive
+    typedef struct live_interval {
+        std::size_t start;
+        std::size_t end;
+        bool slot;
+        std::uint32_t id;
+    } live_interval;
+
+    class function_lowering
+    {
+    private:
+        ir_module& module;
+        ir_function& fn;
+        assembler& as;
+        operating_system os;
+        bool allocate_registers;
+        const std::set<std::string>& internal; // labels called with the internal convention
+        const std::vector<std::string>& argument_registers;
+        const std::vector<std::string>& incoming; // registers the parameters of this function arrive in
+        int shadow_space;
+        int incoming_shadow;
+        bool leaf; // nothing called out and no inline asm, so a sysv frame can sit in the red zone
+        bool detects; // the entry of a program using bulk kernels, which picks them before anything runs
+        std::uint32_t returned; // value of the last ret, moved into rax once everything after it ran
+        std::size_t tail; // a call whose result is returned straight away, SIZE_MAX when there is none
+        std::vector<int> param_homes; // sysv frame slots of register parameters, 0 until pulled
+        std::vector<bool> direct; // parameters read straight from the register they arrived in
+        subroutine* sr;
+        std::vector<int> slot_offsets;
+        std::vector<int> slot_registers; // index into SAVED_REGISTERS, -1 for slots in the frame
+        std::vector<int> slot_classes; // size class of the only block a slot ever holds, -1 when unknown
+        std::vector<int> slot_blocks; // frame offset of a slot's frame allocated block, 0 for heap blocks
+        std::vector<value_location> locations;
+        std::vector<const ir_node*> producers;
+        std::vector<std::size_t> definition;
+        std::vector<std::size_t> last_use;
+        std::vector<bool> crosses;
+        std::vector<bool> aliases; // slot loads read straight from the slot's register
+        std::vector<live_interval> slot_spans;
+        std::vector<live_interval> intervals;
+        std::vector<std::size_t> barriers; // inline asm, which may touch any register
+        std::array<std::uint32_t, VALUE_REGISTERS.size()> holders;
+        std::vector<std::uint32_t> arguments;
+        std::vector<int> free_offsets; // frame slots whose owner is dead, handed out again first
+        std::vector<bool> released;
+        int labels;
+        int outgoing; // bytes at the bottom of the frame for the largest call's shadow space and stack arguments
+
+        void emit(std::string instruction)
+        {
+            as.instruct(fn.name, instruction);
+        }
+
+        std::string frame(int offset)
+        {
+            return "qword [rbp + " + std::to_string(offset) + ']';
+        }
+
+        // memory of a value type as an operand. narrower types are sign extended into
+        // whole registers on the way in and cut down to their width on the way out
+        std::string sized(value_type type, const std::string& address)
+        {
+            switch (value_types::size(type))
+            {
+                case 1: return "byte [" + address + ']';
+                case 2: return "word [" + address + ']';
+                case 4: return "dword [" + address + ']';
+                default: return "qword [" + address + ']';
+            }
+        }
+
+        std::string widen(value_type type)
+        {
+            switch (value_types::size(type))
+            {
+                case 1:
+                case 2: return "movsx";
+                case 4: return "movsxd";
+                default: return "mov";
+            }
+        }
+
+        // a floating point value as the source of a scalar sse instruction: its register
+        // when it is in one, otherwise its memory at the width of its type
+        std::string vector_source(std::uint32_t v)
+        {
+            bool single = fn.values[v] == value_types::F32;
+            if (in_register(v))
+                return single ? resolve_register(where(v), 4) : where(v);
+            std::string memory = where(v);
+            return single ? "dword" + memory.substr(memory.find(' ')) : memory;
+        }
+
+        void vector_load(const std::string& xmm, std::uint32_t v)
+        {
+            bool single = fn.values[v] == value_types::F32;
+            if (in_register(v))
+                emit((single ? "movd " : "movq ") + xmm + ", " + vector_source(v));
+            else
+                emit((single ? "movss " : "movsd ") + xmm + ", " + vector_source(v));
+        }
+
+        // a frame slot for the whole function
+        int spill()
+        {
+            return sr->offset_mutilator -= 8;
+        }
+
+        // a frame slot for something with a live range, reusing one a dead value or
+        // reference left behind
+        int take_offset()
+        {
+            if (free_offsets.empty())
+                return spill();
+            int offset = free_offsets.back();
+            free_offsets.pop_back();
+            return offset;
+        }
+
+        // notes a call out of the function needing bytes of outgoing area
+        void reserve_outgoing(int bytes)
+        {
+            outgoing = std::max(outgoing, bytes);
+            leaf = false;
+        }
+
+        void use(std::uint32_t v, std::size_t index)
+        {
+            if (v != NO_VALUE)
+                last_use[v] = std::max(last_use[v], index);
+        }
+
+        // finds the last use of every value and whether anything between its
+        // definition and that use destroys the volatile registers. only the last ret
+        // of a label counts, and its value has to last until the label returns
+        void analyse()
+        {
+            std::size_t count = fn.values.size();
+            definition.assign(count, 0);
+            producers.assign(count, nullptr);
+            last_use.assign(count, 0);
+            crosses.assign(count, false);
+            std::vector<std::size_t> clobbers;
+            std::vector<std::uint32_t> pending;
+            barriers.clear();
+            returned = NO_VALUE;
+            std::vector<const ir_node*> sequence;
+            std::size_t index = 0;
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op == ir_ops::ARG)
+                        pending.push_back(n.a); // arguments are read by the call
+                    else if (ir_ops::reads_a(n.op))
+                        use(n.a, index);
+                    if (ir_ops::reads_b(n.op))
+                        use(n.b, index);
+                    if (n.op == ir_ops::CALL || n.op == ir_ops::BULK)
+                    {
+                        for (std::uint32_t v : pending)
+                            use(v, index);
+                        pending.clear();
+                    }
+                    if (n.dst != NO_VALUE)
+                    {
+                        producers[n.dst] = &n;
+                        definition[n.dst] = index;
+                        last_use[n.dst] = index;
+                    }
+                    if (ir_ops::clobbers(n.op))
+                        clobbers.push_back(index);
+                    if (n.op == ir_ops::ASM)
+                        barriers.push_back(index);
+                    if (n.op == ir_ops::RET)
+                        returned = n.a;
+                    sequence.push_back(&n);
+                    index++;
+                }
+            }
+            tail = find_tail(sequence);
+            if (tail != SIZE_MAX)
+                returned = NO_VALUE; // left in rax by the callee
+            use(returned, index);
+            for (std::uint32_t v = 0; v < count; v++)
+            {
+                auto k = std::upper_bound(clobbers.begin(), clobbers.end(), definition[v]);
+                if (k != clobbers.end() && *k < last_use[v])
+                    crosses[v] = true;
+            }
+        }
+
+        // the last call, when the label does nothing after it but return its result.
+        // what comes after may only go through slots and frame allocated blocks, which
+        // die with the frame anyway, and the callee has to take every argument in
+        // registers. SIZE_MAX when there is no such call
+        std::size_t find_tail(const std::vector<const ir_node*>& sequence)
+        {
+            std::size_t call = sequence.size();
+            for (std::size_t i = sequence.size(); i-- > 0 && call == sequence.size();)
+            {
+                if (sequence[i]->op == ir_ops::CALL)
+                    call = i;
+            }
+            if (call == sequence.size() || returned == NO_VALUE)
+                return SIZE_MAX;
+            const ir_node& c = *sequence[call];
+            if (internal.count(module.names[c.imm]) == 0 || c.a > internal_registers().size())
+                return SIZE_MAX;
+            std::set<std::int64_t> frame_slots;
+            for (const ir_node* n : sequence)
+            {
+                if (n->op == ir_ops::FRAME_ALLOC)
+                    frame_slots.insert(n->imm);
+            }
+            // what each value, slot and block is known to hold, in terms of values from
+            // before the call
+            std::map<std::uint32_t, std::uint32_t> same;
+            std::map<std::int64_t, std::uint32_t> slots, blocks;
+            auto resolve = [&](std::uint32_t v)
+            {
+                auto it = same.find(v);
+                return it == same.end() ? v : it->second;
+            };
+            // the frame allocated block a value points to, -1 when it is not one
+            auto block = [&](std::uint32_t v)
+            {
+                const ir_node* p = producers[v];
+                return p != nullptr && p->op == ir_ops::LOAD_SLOT && frame_slots.count(p->imm) != 0 ? p->imm : -1;
+            };
+            for (std::size_t i = call + 1; i < sequence.size(); i++)
+            {
+                const ir_node& n = *sequence[i];
+                switch (n.op)
+                {
+                    case ir_ops::CONST:
+                    case ir_ops::RET:
+                        break;
+                    case ir_ops::FRAME_ALLOC:
+                        blocks.erase(n.imm);
+                        break;
+                    case ir_ops::LOAD_SLOT:
+                        if (slots.count(n.imm) != 0)
+                            same[n.dst] = slots[n.imm];
+                        break;
+                    case ir_ops::STORE_SLOT:
+                        slots[n.imm] = resolve(n.a);
+                        break;
+                    case ir_ops::LOAD:
+                        if (block(n.a) != -1 && blocks.count(block(n.a)) != 0 && value_types::size(n.type) == 8)
+                            same[n.dst] = blocks[block(n.a)];
+                        break;
+                    case ir_ops::STORE:
+                        if (block(n.a) == -1 || value_types::size(n.type) != 8)
+                            return SIZE_MAX;
+                        blocks[block(n.a)] = resolve(n.b);
+                        break;
+                    default:
+                        return SIZE_MAX;
+                }
+            }
+            return resolve(returned) == c.dst ? call : SIZE_MAX;
+        }
+
+        bool spans_barrier(std::size_t start, std::size_t end)
+        {
+            auto k = std::upper_bound(barriers.begin(), barriers.end(), start);
+            return k != barriers.end() && *k < end;
+        }
+
+        // builds the intervals the allocator works on: every slot from its first to
+        // its last access, and every value that has to outlive a call. a load of a slot
+        // nothing writes to again while the loaded value lives is read from the slot's
+        // register directly, so its uses stretch the slot's interval instead
+        void collect()
+        {
+            std::vector<live_interval> slots(fn.slots.size(), { SIZE_MAX, 0, true, 0 });
+            std::vector<std::vector<std::size_t>> writes(fn.slots.size());
+            std::vector<std::pair<std::uint32_t, std::size_t>> loads;
+            slot_classes.assign(fn.slots.size(), -1);
+            std::size_t index = 0;
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op == ir_ops::LOAD_SLOT || n.op == ir_ops::STORE_SLOT || n.op == ir_ops::ALLOC || n.op == ir_ops::FREE)
+                    {
+                        slots[n.imm].start = std::min(slots[n.imm].start, index);
+                        slots[n.imm].end = std::max(slots[n.imm].end, index);
+                    }
+                    if (n.op == ir_ops::STORE_SLOT || n.op == ir_ops::ALLOC)
+                    {
+                        slot_classes[n.imm] = n.op == ir_ops::ALLOC && writes[n.imm].empty() ? size_class(n) : -1;
+                        writes[n.imm].push_back(index);
+                    }
+                    if (n.op == ir_ops::LOAD_SLOT)
+                        loads.push_back({ n.dst, n.imm });
+                    index++;
+                }
+            }
+            aliases.assign(fn.values.size(), false);
+            for (auto [v, s] : loads)
+            {
+                auto k = std::upper_bound(writes[s].begin(), writes[s].end(), definition[v]);
+                if (k != writes[s].end() && *k <= last_use[v])
+                    continue;
+                aliases[v] = true;
+                slots[s].end = std::max(slots[s].end, last_use[v]);
+            }
+            intervals.clear();
+            for (std::uint32_t s = 0; s < slots.size(); s++)
+            {
+                slots[s].id = s;
+                if (slots[s].start != SIZE_MAX && slot_blocks[s] == 0 && !spans_barrier(slots[s].start, slots[s].end))
+                    intervals.push_back(slots[s]);
+            }
+            slot_spans = std::move(slots);
+            for (std::uint32_t v = 0; v < fn.values.size(); v++)
+            {
+                if (crosses[v] && !aliases[v] && !locations[v].constant && !points_to_block(v) && !spans_barrier(definition[v], last_use[v]))
+                    intervals.push_back({ definition[v], last_use[v], false, v });
+            }
+            std::sort(intervals.begin(), intervals.end(), [](const live_interval& a, const live_interval& b) { return a.start < b.start; });
+        }
+
+        void assign(const live_interval& interval, int reg)
+        {
+            if (interval.slot)
+                slot_registers[interval.id] = reg;
+            else
+                locations[interval.id].saved = reg;
+        }
+
+        // linear scan: intervals are handed free registers in order of their start, and
+        // when none is left whichever live interval ends last goes back to the frame
+        void allocate()
+        {
+            std::size_t available = os == operating_systems::WINDOWS ? SAVED_REGISTERS.size() : SAVED_REGISTERS.size() - 2;
+            std::vector<int> free;
+            for (int r = available - 1; r >= 0; r--)
+                free.push_back(r);
+            std::vector<std::pair<live_interval, int>> active; // sorted by end
+            std::vector<bool> used(SAVED_REGISTERS.size(), false);
+            for (live_interval& interval : intervals)
+            {
+                while (!active.empty() && active.front().first.end < interval.start)
+                {
+                    free.push_back(active.front().second);
+                    active.erase(active.begin());
+                }
+                int reg;
+                if (!free.empty())
+                {
+                    reg = free.back();
+                    free.pop_back();
+                }
+                else if (active.back().first.end > interval.end)
+                {
+                    reg = active.back().second;
+                    assign(active.back().first, -1);
+                    active.pop_back();
+                }
+                else
+                    continue;
+                assign(interval, reg);
+                used[reg] = true;
+                auto at = std::upper_bound(active.begin(), active.end(), interval.end, [](std::size_t end, const std::pair<live_interval, int>& a) { return end < a.first.end; });
+                active.insert(at, { interval, reg });
+            }
+            for (std::size_t r = 0; r < used.size(); r++)
+            {
+                if (used[r])
+                    sr->saved_registers.push_back({ SAVED_REGISTERS[r], spill() });
+            }
+        }
+
+        bool points_to_block(std::uint32_t v)
+        {
+            return producers[v] != nullptr && producers[v]->op == ir_ops::LOAD_SLOT && slot_blocks[producers[v]->imm] != 0;
+        }
+
+        // the address a value holds, as the inside of a memory operand. pointers to
+        // frame allocated blocks become rbp relative, anything else goes through tmp
+        // when it is not already in a register
+        std::string address(std::uint32_t v, const std::string& tmp)
+        {
+            if (locations[v].block != 0)
+                return "rbp + " + std::to_string(locations[v].block);
+            return in(v, tmp);
+        }
+
+        bool number(std::uint32_t v, std::int64_t& n)
+        {
+            if (v == NO_VALUE || producers[v] == nullptr || producers[v]->op != ir_ops::CONST)
+                return false;
+            n = producers[v]->imm;
+            return true;
+        }
+
+        // the size class a ref allocates from, -1 when its size is not known or too large
+        int size_class(const ir_node& n)
+        {
+            std::int64_t size, alignment = 8;
+            if (!number(n.a, size) || (n.b != NO_VALUE && !number(n.b, alignment)))
+                return -1;
+            return runtime::size_class(size, alignment);
+        }
+
+        // the frame slot a parameter not read from its register is read from. on
+        // windows the caller's shadow space and stack arguments sit right above the
+        // return address, and the prologue spills the register ones into their shadow
+        // slots. sysv and the internal convention have no shadow space, so register
+        // parameters are spilled into the function's own frame instead
+        int param_home(std::size_t i)
+        {
+            if (i >= incoming.size())
+                return 16 + (int) (incoming_shadow + (i - incoming.size()) * 8);
+            if (incoming_shadow != 0)
+            {
+                int offset = 16 + (int) i * 8;
+                if (std::find(sr->homes.begin(), sr->homes.end(), std::make_pair(incoming[i], offset)) == sr->homes.end())
+                    sr->homes.push_back({ incoming[i], offset });
+                return offset;
+            }
+            if (param_homes.size() <= i)
+                param_homes.resize(i + 1, 0);
+            if (param_homes[i] == 0)
+            {
+                param_homes[i] = spill();
+                sr->homes.push_back({ incoming[i], param_homes[i] });
+            }
+            return param_homes[i];
+        }
+
+        // parameters pulled before anything calls out are still in the registers they
+        // came in, which are kept from everything else until the pull
+        void pin_params()
+        {
+            direct.assign(fn.params, false);
+            int pinned = 0;
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (ir_ops::clobbers(n.op))
+                        return;
+                    if (n.op != ir_ops::PARAM || (std::size_t) n.imm >= incoming.size())
+                        continue;
+                    int r = register_index(incoming[n.imm]);
+                    if (r != -1 && pinned == DIRECT_PARAMS)
+                        continue;
+                    direct[n.imm] = true;
+                    if (r != -1)
+                    {
+                        holders[r] = PINNED;
+                        pinned++;
+                    }
+                }
+            }
+        }
+
+        std::string slot_home(int s)
+        {
+            return slot_registers[s] != -1 ? SAVED_REGISTERS[slot_registers[s]] : frame(slot_offsets[s]);
+        }
+
+        std::string where(std::uint32_t v)
+        {
+            value_location& l = locations[v];
+            if (l.reg != -1)
+                return VALUE_REGISTERS[l.reg];
+            if (l.saved != -1)
+                return SAVED_REGISTERS[l.saved];
+            if (l.constant)
+                return l.immediate;
+            return frame(l.offset);
+        }
+
+        bool in_register(std::uint32_t v)
+        {
+            return locations[v].reg != -1 || locations[v].saved != -1;
+        }
+
+        int free_registers()
+        {
+            return std::count(holders.begin(), holders.end(), NO_VALUE);
+        }
+
+        // gives a newly defined value its home
+        void place(std::uint32_t v, int preferred = -1)
+        {
+            value_location& l = locations[v];
+            if (l.saved != -1)
+                return; // given a register by the allocator
+            if (crosses[v] || free_registers() <= SCRATCH_RESERVE)
+            {
+                l.offset = take_offset();
+                return;
+            }
+            int r = preferred != -1 && holders[preferred] == NO_VALUE ? preferred : -1;
+            for (std::size_t i = 0; r == -1 && i < holders.size(); i++)
+            {
+                if (holders[i] == NO_VALUE)
+                    r = i;
+            }
+            holders[r] = v;
+            l.reg = r;
+        }
+
+        // frees the register or frame slot of a value once the node at index was its
+        // last use. the location is kept so the node can still read it
+        void release(std::uint32_t v, std::size_t index)
+        {
+            if (v == NO_VALUE || last_use[v] > index || released[v])
+                return;
+            released[v] = true;
+            value_location& l = locations[v];
+            if (l.reg != -1 && holders[l.reg] == v)
+                holders[l.reg] = NO_VALUE;
+            if (l.offset != 0)
+                free_offsets.push_back(l.offset);
+        }
+
+        std::string scratch(std::initializer_list<std::string> avoid)
+        {
+            for (std::size_t i = 0; i < holders.size(); i++)
+            {
+                if (holders[i] == NO_VALUE && std::find(avoid.begin(), avoid.end(), VALUE_REGISTERS[i]) == avoid.end())
+                    return VALUE_REGISTERS[i];
+            }
+            throw std::runtime_error("ran out of scratch registers while lowering " + fn.name);
+        }
+
+        // the value in a register, moved into tmp first when it is not in one
+        std::string in(std::uint32_t v, const std::string& tmp)
+        {
+            if (in_register(v))
+                return where(v);
+            emit("mov " + tmp + ", " + where(v));
+            return tmp;
+        }
+
+        // the value as the source operand of an instruction whose destination is a
+        // register, or memory when to_memory is set
+        std::string source(std::uint32_t v, bool to_memory, const std::string& tmp)
+        {
+            value_location& l = locations[v];
+            if (in_register(v) || l.small)
+                return where(v);
+            if (!l.constant && !to_memory)
+                return where(v);
+            return in(v, tmp);
+        }
+
+        // writes a register holding the result of a node to where dst lives
+        void define(std::uint32_t dst, const std::string& reg)
+        {
+            if (where(dst) != reg)
+                emit("mov " + where(dst) + ", " + reg);
+        }
+
+        // the register a node should compute dst into
+        std::string target(std::uint32_t dst, std::initializer_list<std::string> avoid)
+        {
+            if (in_register(dst))
+                return where(dst);
+            return scratch(avoid);
+        }
+
+        // a tail call only moves the arguments here. the epilogue then restores what
+        // the label saved and jumps to the callee, which returns to the label's caller
+        void call(const std::string& name, bool tail, bool to_kernel = false)
+        {
+            bool to_label = internal.count(name) != 0;
+            bool to_extern = module.externs.count(name) != 0;
+            const std::vector<std::string>& registers = to_kernel ? runtime::KERNEL_REGISTERS : to_label ? internal_registers() : argument_registers;
+            int shadow = to_label || to_kernel ? 0 : shadow_space;
+            // floating point arguments of externs go in vector registers. system v gives
+            // them registers of their own, windows the one of their position as well as
+            // the integer register, which is what variadic callees read. nothing is
+            // promoted, so variadic callees such as printf have to be passed doubles
+            std::vector<std::uint32_t> integers, vectors, stacked;
+            bool separate = to_extern && os != operating_systems::WINDOWS;
+            auto real = [&](std::uint32_t v) { return to_extern && value_types::floating(fn.values[v]); };
+            for (std::uint32_t v : arguments)
+            {
+                if (separate && real(v) && vectors.size() < VECTOR_ARGUMENTS)
+                    vectors.push_back(v);
+                else if ((!separate || !real(v)) && integers.size() < registers.size())
+                    integers.push_back(v);
+                else
+                    stacked.push_back(v);
+            }
+            for (std::size_t i = 0; i < stacked.size(); i++)
+            {
+                std::string slot = "qword [rsp + " + std::to_string(shadow + i * 8) + ']';
+                emit("mov " + slot + ", " + source(stacked[i], true, scratch({})));
+            }
+            // vector registers first, as the integer moves can overwrite what they are loaded from
+            for (std::size_t i = 0; i < vectors.size(); i++)
+                vector_load("xmm" + std::to_string(i), vectors[i]);
+            // register arguments form a parallel move: a register can only be written
+            // once nothing left to move still reads it, and cycles are broken with xchg
+            std::vector<std::pair<std::string, std::string>> moves;
+            for (std::size_t i = 0; i < integers.size(); i++)
+            {
+                if (in_register(integers[i]) && where(integers[i]) != registers[i])
+                    moves.push_back({ registers[i], where(integers[i]) });
+            }
+            while (!moves.empty())
+            {
+                std::size_t m = 0;
+                for (; m < moves.size(); m++)
+                {
+                    bool read = false;
+                    for (auto& other : moves)
+                        read = read || other.second == moves[m].first;
+                    if (!read)
+                        break;
+                }
+                if (m < moves.size())
+                {
+                    emit("mov " + moves[m].first + ", " + moves[m].second);
+                    moves.erase(moves.begin() + m);
+                    continue;
+                }
+                auto [dst, src] = moves[0];
+                emit("xchg " + dst + ", " + src);
+                moves.erase(moves.begin());
+                for (auto& other : moves)
+                {
+                    if (other.second == dst)
+                        other.second = src;
+                }
+            }
+            for (std::size_t i = 0; i < integers.size(); i++)
+            {
+                if (!in_register(integers[i]))
+                    emit("mov " + registers[i] + ", " + where(integers[i]));
+                if (separate || !real(integers[i]))
+                    continue;
+                if (fn.values[integers[i]] == value_types::F32)
+                    emit("movd xmm" + std::to_string(i) + ", " + resolve_register(registers[i], 4));
+                else
+                    emit("movq xmm" + std::to_string(i) + ", " + registers[i]);
+            }
+            if (tail)
+            {
+                sr->ending = "jmp " + name;
+                return;
+            }
+            reserve_outgoing(shadow + stacked.size() * 8);
+            if (os == operating_systems::LINUX && to_extern)
+            {
+                // al tells a variadic callee how many vector registers carry arguments,
+                // and externs are reached through the plt so the output links as pie
+                emit("mov eax, " + std::to_string(vectors.size()));
+                emit("call " + name + " wrt ..plt");
+            }
+            else
+                emit("call " + name);
+        }
+
+        bool lower_node(ir_node& n, std::size_t index)
+        {
+            switch (n.op)
+            {
+                case ir_ops::CONST:
+                    return true; // rematerialized at every use
+                case ir_ops::STRING:
+                {
+                    if (locations[n.dst].constant)
+                        return true;
+                    place(n.dst);
+                    std::string reg = target(n.dst, {});
+                    emit("lea " + reg + ", [rel L" + std::to_string(n.imm + 1) + ']');
+                    define(n.dst, reg);
+                    return true;
+                }
+                case ir_ops::LOAD_SLOT:
+                case ir_ops::PARAM:
+                {
+                    std::string home;
+                    if (n.op == ir_ops::PARAM && direct[n.imm])
+                    {
+                        int r = register_index(incoming[n.imm]);
+                        if (r != -1)
+                            holders[r] = NO_VALUE;
+                        place(n.dst, r);
+                        define(n.dst, incoming[n.imm]);
+                        return true;
+                    }
+                    if (n.op == ir_ops::PARAM)
+                        home = frame(param_home(n.imm));
+                    else if (slot_blocks[n.imm] != 0)
+                    {
+                        locations[n.dst].block = slot_blocks[n.imm];
+                        return true;
+                    }
+                    else if (aliases[n.dst] && slot_registers[n.imm] != -1)
+                    {
+                        locations[n.dst].saved = slot_registers[n.imm];
+                        return true;
+                    }
+                    else
+                        home = slot_home(n.imm);
+                    place(n.dst);
+                    std::string reg = target(n.dst, {});
+                    emit("mov " + reg + ", " + home);
+                    define(n.dst, reg);
+                    return true;
+                }
+                case ir_ops::STORE_SLOT:
+                {
+                    emit("mov " + slot_home(n.imm) + ", " + source(n.a, slot_registers[n.imm] == -1, scratch({})));
+                    release(n.a, index);
+                    return true;
+                }
+                case ir_ops::LOAD:
+                {
+                    release(n.a, index);
+                    place(n.dst);
+                    std::string reg = target(n.dst, { where(n.a) });
+                    emit(widen(n.type) + ' ' + reg + ", " + sized(n.type, address(n.a, reg)));
+                    define(n.dst, reg);
+                    return true;
+                }
+                case ir_ops::STORE:
+                {
+                    std::string to = address(n.a, scratch({ where(n.a), where(n.b) }));
+                    std::string from = source(n.b, true, scratch({ to, where(n.b) }));
+                    int size = value_types::size(n.type);
+                    std::int64_t constant = 0;
+                    if (size < 8 && register_family(from) != -1)
+                        from = resolve_register(from, size);
+                    else if (size < 8 && number(n.b, constant))
+                        from = std::to_string(size == 1 ? (std::int8_t) constant : size == 2 ? (std::int16_t) constant : (std::int32_t) constant);
+                    emit("mov " + sized(n.type, to) + ", " + from);
+                    release(n.a, index);
+                    release(n.b, index);
+                    return true;
+                }
+                case ir_ops::ADD:
+                {
+                    release(n.a, index);
+                    release(n.b, index);
+                    place(n.dst);
+                    if (value_types::floating(n.type))
+                    {
+                        // through xmm0, with the result's bits moved back out
+                        std::string reg = target(n.dst, {});
+                        bool single = n.type == value_types::F32;
+                        vector_load("xmm0", n.a);
+                        std::string addend = vector_source(n.b);
+                        if (in_register(n.b))
+                        {
+                            vector_load("xmm1", n.b);
+                            addend = "xmm1";
+                        }
+                        emit((single ? "addss xmm0, " : "addsd xmm0, ") + addend);
+                        emit(single ? "movd " + resolve_register(reg, 4) + ", xmm0" : "movq " + reg + ", xmm0");
+                        define(n.dst, reg);
+                        return true;
+                    }
+                    std::string reg = target(n.dst, { where(n.a), where(n.b) });
+                    std::uint32_t first = n.a, second = n.b;
+                    if (reg == where(n.b) && reg != where(n.a))
+                        std::swap(first, second); // addition commutes, so add into the operand already there
+                    if (reg != where(first))
+                        emit("mov " + reg + ", " + where(first));
+                    emit("add " + reg + ", " + source(second, false, scratch({ reg, where(n.a), where(n.b) })));
+                    define(n.dst, reg);
+                    return true;
+                }
+                case ir_ops::ALLOC:
+                case ir_ops::FREE:
+                {
+                    if (os != operating_systems::WINDOWS && os != operating_systems::LINUX)
+                    {
+                        arrow::err("unsupported operation for output operating system " + operating_systems::name(os), n.line);
+                        return false;
+                    }
+                    if (n.op == ir_ops::ALLOC)
+                    {
+                        reserve_outgoing(shadow_space);
+                        int c = size_class(n);
+                        if (c != -1)
+                        {
+                            // pop the class's free list, which the runtime only has to
+                            // refill when it is empty
+                            std::string popped = ".ref" + std::to_string(labels++);
+                            emit("mov rax, " + runtime::free_list(c));
+                            emit("test rax, rax");
+                            emit("jnz " + popped);
+                            emit("mov ecx, " + std::to_string(c));
+                            emit("call " + runtime::REFILL);
+                            emit(popped + ':');
+                            emit("mov rcx, qword [rax]");
+                            emit("mov " + runtime::free_list(c) + ", rcx");
+                            emit("mov qword [rax], 0");
+                        }
+                        else
+                        {
+                            std::int64_t alignment = 8;
+                            number(n.b, alignment);
+                            emit("mov rcx, " + where(n.a));
+                            emit("mov edx, " + std::to_string(alignment));
+                            emit("call " + runtime::ALLOCATE);
+                        }
+                        emit("mov " + slot_home(n.imm) + ", rax");
+                        release(n.a, index);
+                        return true;
+                    }
+                    int c = slot_classes[n.imm];
+                    emit("mov rcx, " + slot_home(n.imm));
+                    if (c == -1 || runtime::class_size(c) > runtime::MAX_ALIGNMENT)
+                    {
+                        reserve_outgoing(shadow_space);
+                        emit("call " + runtime::RELEASE);
+                        return true;
+                    }
+                    // the block's class is known here, so it is cleared and pushed back
+                    // without calling out. the first qword is the link
+                    for (int offset = 8; offset < runtime::class_size(c); offset += 8)
+                        emit("mov qword [rcx + " + std::to_string(offset) + "], 0");
+                    emit("mov rax, " + runtime::free_list(c));
+                    emit("mov qword [rcx], rax");
+                    emit("mov " + runtime::free_list(c) + ", rcx");
+                    return true;
+                }
+                case ir_ops::FRAME_ALLOC:
+                {
+                    // heap blocks start out zeroed, so these do too
+                    std::int64_t size = 0;
+                    number(n.a, size);
+                    for (int offset = 0; offset < size; offset += 8)
+                        emit("mov " + frame(slot_blocks[n.imm] + offset) + ", 0");
+                    return true;
+                }
+                case ir_ops::ARG:
+                {
+                    if (arguments.size() <= (std::size_t) n.imm)
+                        arguments.resize(n.imm + 1, NO_VALUE);
+                    arguments[n.imm] = n.a;
+                    return true;
+                }
+                case ir_ops::CALL:
+                {
+                    call(module.names[n.imm], index == tail);
+                    for (std::uint32_t v : arguments)
+                        release(v, index);
+                    arguments.clear();
+                    if (index == tail)
+                        return true;
+                    place(n.dst, register_index("rax"));
+                    if (value_types::floating(n.type) && module.externs.count(module.names[n.imm]) != 0)
+                        emit(n.type == value_types::F32 ? "movd eax, xmm0" : "movq rax, xmm0");
+                    define(n.dst, "rax");
+                    return true;
+                }
+                case ir_ops::BULK:
+                {
+                    if (os != operating_systems::WINDOWS && os != operating_systems::LINUX)
+                    {
+                        arrow::err("unsupported operation for output operating system " + operating_systems::name(os), n.line);
+                        return false;
+                    }
+                    call(runtime::kernel(n.imm, n.type), false, true);
+                    for (std::uint32_t v : arguments)
+                        release(v, index);
+                    arguments.clear();
+                    return true;
+                }
+                case ir_ops::RET:
+                {
+                    release(n.a, index); // the last ret's value lives on until the end
+                    return true;
+                }
+                case ir_ops::ASM:
+                {
+                    leaf = false;
+                    as.raw(fn.name, module.names[n.imm]);
+                    return true;
+                }
+            }
+            arrow::err("cannot lower " + ir_ops::name(n.op), n.line);
+            return false;
+        }
+
+        const std::vector<std::string>& internal_registers()
+        {
+            return os == operating_systems::WINDOWS ? WINDOWS_INTERNAL_REGISTERS : SYSV_INTERNAL_REGISTERS;
+        }
+    public:
+        function_lowering(ir_module& module, ir_function& fn, assembler& as, operating_system os, bool allocate_registers, const std::set<std::string>& internal, bool detects) :
+            module(module), fn(fn), as(as), internal(internal),
+            argument_registers(os == operating_systems::WINDOWS ? X64_CALLING_CONVENTION_REGISTERS : SYSV_CALLING_CONVENTION_REGISTERS),
+            incoming(internal.count(fn.name) != 0 ? (os == operating_systems::WINDOWS ? WINDOWS_INTERNAL_REGISTERS : SYSV_INTERNAL_REGISTERS) : argument_registers)
+        {
+            this->os = os;
+            this->allocate_registers = allocate_registers;
+            sr = as.sr(fn.name);
+            labels = 0;
+            outgoing = 0;
+            shadow_space = os == operating_systems::WINDOWS ? SHADOW_SPACE : 0;
+            incoming_shadow = internal.count(fn.name) != 0 ? 0 : shadow_space;
+            leaf = true;
+            this->detects = detects;
+            holders.fill(NO_VALUE);
+        }
+
+        bool run()
+        {
+            analyse();
+            locations.assign(fn.values.size(), { -1, -1, 0, false, false, "", 0 });
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op == ir_ops::CONST && value_types::floating(n.type))
+                        locations[n.dst] = { -1, -1, 0, true, false, "qword [rel " + real_label(n.imm) + ']', 0 };
+                    else if (n.op == ir_ops::CONST)
+                        locations[n.dst] = { -1, -1, 0, true, n.imm >= INT32_MIN && n.imm <= INT32_MAX, std::to_string(n.imm), 0 };
+                    else if (n.op == ir_ops::STRING && os != operating_systems::LINUX)
+                        locations[n.dst] = { -1, -1, 0, true, false, 'L' + std::to_string(n.imm + 1), 0 };
+                }
+            }
+            slot_registers.assign(fn.slots.size(), -1);
+            released.assign(fn.values.size(), false);
+            // frame allocated blocks live as long as the function. they are rounded up
+            // to whole qwords and only ever asked to be 16 byte aligned, which rbp is
+            slot_blocks.assign(fn.slots.size(), 0);
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op != ir_ops::FRAME_ALLOC)
+                        continue;
+                    std::int64_t size = 0, alignment = 8;
+                    number(n.a, size);
+                    number(n.b, alignment);
+                    sr->offset_mutilator -= std::max<int>(8, (size + 7) & ~7);
+                    sr->offset_mutilator &= ~((int) alignment - 1);
+                    slot_blocks[n.imm] = sr->offset_mutilator;
+                }
+            }
+            collect();
+            if (allocate_registers)
+                allocate();
+            pin_params();
+            // references left in the frame get a slot for their live range only, so the
+            // slot of one that was deleted goes to whatever is needed next
+            slot_offsets.assign(fn.slots.size(), 0);
+            std::vector<live_interval> framed;
+            for (live_interval& span : slot_spans)
+            {
+                if (span.start != SIZE_MAX && slot_registers[span.id] == -1 && slot_blocks[span.id] == 0)
+                    framed.push_back(span);
+            }
+            std::sort(framed.begin(), framed.end(), [](const live_interval& a, const live_interval& b) { return a.start < b.start; });
+            std::vector<live_interval> ending = framed;
+            std::sort(ending.begin(), ending.end(), [](const live_interval& a, const live_interval& b) { return a.end < b.end; });
+            std::size_t opened = 0, closed = 0;
+            std::size_t index = 0;
+            if (detects)
+            {
+                reserve_outgoing(0);
+                emit("call " + runtime::DETECT);
+            }
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (index > tail)
+                        break; // only what dies with the frame follows a tail call
+                    for (; opened < framed.size() && framed[opened].start == index; opened++)
+                        slot_offsets[framed[opened].id] = take_offset();
+                    if (!lower_node(n, index))
+                        return false;
+                    release(n.dst, index); // values nothing reads
+                    for (; closed < ending.size() && ending[closed].end == index; closed++)
+                        free_offsets.push_back(slot_offsets[ending[closed].id]);
+                    index++;
+                }
+            }
+            if (returned != NO_VALUE && where(returned) != "rax")
+                emit("mov rax, " + where(returned));
+            // locals sit below rbp and the outgoing area below them at rsp, which the
+            // prologue leaves 16 byte aligned for every call. a sysv leaf small enough
+            // for the red zone never moves rsp at all
+            if (os == operating_systems::WINDOWS || !leaf || -sr->offset_mutilator > RED_ZONE)
+                sr->alloc_delta(align16(-sr->offset_mutilator + outgoing));
+            return true;
+        }
+    };
+
+    // whether name appears in text as a whole word
+    bool mentions(const std::string& text, const std::string& name)
+    {
+        auto identifier = [](char c) { return std::isalnum((unsigned char) c) || c == '_' || c == '.' || c == '$' || c == '@'; };
+        for (std::size_t at = text.find(name); at != std::string::npos; at = text.find(name, at + 1))
+        {
+            if ((at == 0 || !identifier(text[at - 1])) && (at + name.length() == text.length() || !identifier(text[at + name.length()])))
+                return true;
+        }
+        return false;
+    }
+
+    bool lower(ir_module& module, assembler& as, operating_system os, bool allocate_registers)
+    {
+        for (auto& e : module.externs)
+            as.external(e);
+        if (os == operating_systems::WINDOWS)
+            as.read_only = ".rdata";
+        for (std::size_t i = 0; i < module.literals.size(); i++)
+            as.string('L' + std::to_string(i + 1), module.literals[i]);
+        std::set<std::int64_t> reals;
+        for (ir_function& fn : module.functions)
+        {
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op == ir_ops::CONST && value_types::floating(n.type))
+                        reals.insert(n.imm);
+                }
+            }
+        }
+        if (!reals.empty())
+            as << arrow::rodata << "align 8";
+        for (std::int64_t bits : reals)
+            as << arrow::rodata << real_label(bits) + " dq " + std::to_string(bits);
+        bool allocates = false;
+        std::set<std::pair<bulk_op, value_type>> kernels;
+        for (ir_function& fn : module.functions)
+        {
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    allocates = allocates || n.op == ir_ops::ALLOC || n.op == ir_ops::FREE;
+                    if (n.op == ir_ops::BULK)
+                        kernels.insert({ n.imm, n.type });
+                }
+            }
+        }
+        bool runtime_target = os == operating_systems::WINDOWS || os == operating_systems::LINUX;
+        if (allocates && runtime_target)
+            runtime::link(as, os);
+        if (!kernels.empty() && runtime_target)
+            runtime::link_kernels(as, kernels);
+        // labels only ever called from the program itself. the entry is called by the c
+        // runtime and inline asm may call anything it names, so those keep the abi
+        std::set<std::string> internal;
+        for (ir_function& fn : module.functions)
+        {
+            if (fn.name != as.entry && module.externs.count(fn.name) == 0)
+                internal.insert(fn.name);
+        }
+        for (ir_function& fn : module.functions)
+        {
+            for (ir_block& block : fn.blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op != ir_ops::ASM)
+                        continue;
+                    for (auto it = internal.begin(); it != internal.end();)
+                        it = mentions(module.names[n.imm], *it) ? internal.erase(it) : std::next(it);
+                }
+            }
+        }
+        for (ir_function& fn : module.functions)
+        {
+            function_lowering lowering = function_lowering(module, fn, as, os, allocate_registers, internal, !kernels.empty() && fn.name == as.entry);
+            if (!lowering.run())
+                return false;
+        }
+        if (os == operating_systems::LINUX)
+            as << arrow::text << "section .note.GNU-stack noalloc noexec nowrite progbits" << arrow::data; // no executable stack
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef ARROW_LOWER_H
+#define ARROW_LOWER_H
+
+#include <string>
+#include <string_view>
+
+#include "ir.h"
+#include "assembler.h"
+
+namespace arrow
+{
+    typedef unsigned int operating_system;
+    namespace operating_systems
+    {
+        const operating_system WINDOWS = 0x00;
+        const operating_system MAC = 0x01;
+        const operating_system LINUX = 0x02;
+        const operating_system UNKNOWN = 0xFF;
+
+        std::string name(operating_system os);
+        operating_system parse(std::string_view name); // returns UNKNOWN for unknown names
+    }
+
+    // emits x86 for every function of the module into the assembler. returns false
+    // after reporting an error when something cannot be expressed for the target.
+    // allocate_registers keeps references and values living across calls in callee
+    // saved registers instead of the frame
+    bool lower(ir_module& module, assembler& as, operating_system os, bool allocate_registers);
+}
+
+#endif
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include <string>
+#include <charconv>
+#include <cstring>
 
 #include "parser.h"
-#include "assembler.h"
+#include "runtime.h"
 
 namespace arrow
 {
@@ -19,23 +21,45 @@ namespace arrow
         }
     }
 
-    namespace operating_systems
+    // the value type a type specifier names
+    value_type specified_type(const token& t)
     {
-        std::string name(operating_system os)
+        switch (t.op)
         {
-            switch (os)
-            {
-                case WINDOWS: return "WINDOWS";
-                case MAC: return "MAC";
-                case LINUX: return "LINUX";
-                default: return "UNKNOWN_OS_" + std::to_string(os);
-            }
+            case opcodes::BYTE: return value_types::I8;
+            case opcodes::SHORT: return value_types::I16;
+            case opcodes::INT: return value_types::I32;
+            case opcodes::FLOAT: return value_types::F32;
+            case opcodes::DOUBLE: return value_types::F64;
+            default: return value_types::I64;
         }
     }
 
-    bool check_eof(token*& t, bool msg)
+    // the type specifier naming a value type, for messages
+    std::string specifier(value_type type)
+    {
+        switch (type)
+        {
+            case value_types::I8: return "byte";
+            case value_types::I16: return "short";
+            case value_types::I32: return "int";
+            case value_types::F32: return "float";
+            case value_types::F64: return "double";
+            default: return "long";
+        }
+    }
+
+    parser::parser(std::vector<token>& tokens) : tokens(tokens)
+    {
+        current = 0;
+        current_scope = nullptr;
+        last_result = NO_VALUE;
+        statements = 0;
+    }
+
+    bool parser::check_eof(std::size_t t, bool msg)
     {
-        if (t == nullptr)
+        if (t >= tokens.size())
         {
             if (msg) arrow::err("unexpectedly reached end of file");
             return true;
@@ -43,271 +67,410 @@ namespace arrow
         return false;
     }
 
-    bool check_eof(token*& t)
+    ir_function& parser::fn()
     {
-        return check_eof(t, true);
+        return module.functions[current_scope->function];
     }
 
-    parser::parser(token* start, operating_system os)
+    bool parser::good()
     {
-        current = start;
-        current_scope = nullptr;
-        this->os = os;
-        literal_counter = 0;
-        arguments = 0;
+        return current < tokens.size();
+    }
+
+    // statement handlers indexed by the opcode of the token that starts the statement.
+    // labels are the one statement that starts with a non-keyword
+    const std::array<parser::handler, opcodes::COUNT> HANDLERS = []
+    {
+        std::array<parser::handler, opcodes::COUNT> handlers = {};
+        handlers[opcodes::NONE] = &parser::label_start;
+        handlers[opcodes::RIGHT_BRACE] = &parser::label_end;
+        handlers[opcodes::ASM] = &parser::il_asm;
+        handlers[opcodes::STORE] = &parser::store;
+        handlers[opcodes::PASS] = &parser::pass;
+        handlers[opcodes::PULL] = &parser::pull;
+        handlers[opcodes::DEL] = &parser::del;
+        handlers[opcodes::DEF] = &parser::define;
+        handlers[opcodes::COPY] = &parser::copy;
+        handlers[opcodes::ADD] = &parser::add;
+        handlers[opcodes::RET] = &parser::ret;
+        handlers[opcodes::SET] = &parser::set;
+        handlers[opcodes::REF] = &parser::reference;
+        handlers[opcodes::CALL] = &parser::call;
+        handlers[opcodes::VADD] = &parser::bulk;
+        handlers[opcodes::VMUL] = &parser::bulk;
+        handlers[opcodes::VFILL] = &parser::bulk;
+        handlers[opcodes::VCOPY] = &parser::bulk;
+        return handlers;
+    }();
+
+    evaluation_state parser::statement(std::size_t& t)
+    {
+        if (check_eof(t, false)) return evaluation_states::NEUTRAL;
+        statements++;
+        opcode op = tokens[t].op;
+        if (current_scope == nullptr && op != opcodes::NONE && op != opcodes::DEF && op != opcodes::RIGHT_BRACE && HANDLERS[op] != nullptr)
+        {
+            arrow::err("'" + std::string(tokens[t].content) + "' has to be inside a label", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        handler h = HANDLERS[op];
+        evaluation_state e = h != nullptr ? (this->*h)(t) : evaluation_states::NEUTRAL;
+        if (e == evaluation_states::NEUTRAL)
+        {
+            arrow::err("unexpected '" + std::string(tokens[t].content) + "'", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        return e;
     }
 
-    bool parser::good()
+    evaluation_state parser::statement()
+    {
+        std::size_t& c = current;
+        return statement(c);
+    }
+
+    std::size_t parser::statement_count()
     {
-        return current != nullptr;
+        return statements;
     }
 
-    evaluation_state parser::label_start(token*& t)
+    evaluation_state parser::label_start(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (check_eof(t->next, false)) return evaluation_states::NEUTRAL;
-        if (t->next->content != "{") return evaluation_states::NEUTRAL;
-        if (symbols.find(t->content) != symbols.end())
+        if (check_eof(t + 1, false)) return evaluation_states::NEUTRAL;
+        if (tokens[t + 1].op != opcodes::LEFT_BRACE) return evaluation_states::NEUTRAL;
+        if (symbols.find(tokens[t].content) != symbols.end())
         {
-            arrow::err("symbol '" + t->content + "' is already defined", t->line);
+            arrow::err("symbol '" + std::string(tokens[t].content) + "' is already defined", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        symbol& label = symbols[t->content] = { t, current_scope, 0 };
-        t = t->next->next;
+        int function = module.function(std::string(tokens[t].content), current_scope != nullptr ? current_scope->function : -1);
+        symbol& label = symbols[std::string(tokens[t].content)] = { &tokens[t], current_scope, function, -1, value_types::VOID };
+        t = t + 2;
         current_scope = &label;
+        last_result = NO_VALUE;
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::label_start()
     {
-        if (current != nullptr)
-            std::cout << current->content << std::endl;
-        token*& c = current;
+        std::size_t& c = current;
         return label_start(c);
     }
 
-    evaluation_state parser::label_end(token*& t)
+    evaluation_state parser::label_end(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "}") return evaluation_states::NEUTRAL;
+        if (tokens[t].op != opcodes::RIGHT_BRACE) return evaluation_states::NEUTRAL;
         if (current_scope == nullptr)
         {
-            arrow::err("unexpected right curly brace", t->line);
+            arrow::err("unexpected right curly brace", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        t = t->next;
+        t++;
         current_scope = current_scope->scope; // scope out
+        if (current_scope != nullptr)
+            fn().open_block(); // the enclosing label carries on after the nested one
+        last_result = NO_VALUE;
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::label_end()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return label_end(c);
     }
 
-    evaluation_state parser::define(token*& t)
+    evaluation_state parser::define(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "def") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next))
+        if (tokens[t].op != opcodes::DEF) return evaluation_states::NEUTRAL;
+        if (check_eof(++t))
             return evaluation_states::SYNTAX_ERROR;
-        if (t->type != token_types::IDENTIFIER)
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("identifier expected", t->line);
+            arrow::err("identifier expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (symbols.find(t->content) != symbols.end())
+        if (symbols.find(tokens[t].content) != symbols.end())
         {
-            arrow::err("symbol '" + t->content + "' is already defined", t->line);
+            arrow::err("symbol '" + std::string(tokens[t].content) + "' is already defined", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        symbols[t->content] = { t, current_scope, 0 };
-        as.external(t->content);
-        t = t->next;
+        symbols[std::string(tokens[t].content)] = { &tokens[t], current_scope, -1, -1, value_types::VOID };
+        module.externs.insert(std::string(tokens[t].content));
+        t++;
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::define()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return define(c);
     }
 
-    evaluation_state parser::reference(token*& t)
+    // looks up the reference named by token t, which has to belong to the current label
+    evaluation_state parser::reference_symbol(std::size_t t, symbol*& sym)
+    {
+        auto it = symbols.find(tokens[t].content);
+        if (it == symbols.end())
+        {
+            arrow::err("symbol '" + std::string(tokens[t].content) + "' is not defined", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        sym = &it->second;
+        if (sym->slot == -1)
+        {
+            arrow::err("symbol '" + std::string(tokens[t].content) + "' is not a reference", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        if (current_scope == nullptr || sym->function != current_scope->function)
+        {
+            arrow::err("reference '" + std::string(tokens[t].content) + "' does not belong to this label", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        return evaluation_states::FOUND;
+    }
+
+    // whether token t, when it is a number literal, fits a value of type. numbers of
+    // narrow types can be written either signed or unsigned
+    bool parser::fits(std::size_t t, value_type type)
+    {
+        if (tokens[t].type != token_types::NUMERIC_LITERAL || value_types::size(type) == 8 || value_types::floating(type))
+            return true;
+        long long n = 0;
+        std::from_chars(tokens[t].content.data(), tokens[t].content.data() + tokens[t].content.length(), n);
+        int bits = value_types::size(type) * 8;
+        if (n >= -(1LL << (bits - 1)) && n < (1LL << bits))
+            return true;
+        arrow::err("'" + std::string(tokens[t].content) + "' does not fit in " + specifier(type), tokens[t].line);
+        return false;
+    }
+
+    // whether value v can be written to memory of type. integers of any width go
+    // into each other, floating point values only into their own type
+    bool parser::matches(std::uint32_t v, value_type type, int line)
+    {
+        value_type given = fn().values[v];
+        if (!value_types::floating(given) && !value_types::floating(type))
+            return true;
+        if (given == type)
+            return true;
+        arrow::err("cannot write a " + specifier(given) + " value to " + specifier(type), line);
+        return false;
+    }
+
+    evaluation_state parser::reference(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "ref") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
-        if (t->content == "*")
+        if (tokens[t].op != opcodes::REF) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
+        value_type type = value_types::I64;
+        bool typed = tokens[t].type == token_types::TYPE_SPECIFIER;
+        if (typed)
+        {
+            type = specified_type(tokens[t]);
+            if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to identifier
+        }
+        if (tokens[t].op == opcodes::ASTERISK)
         {
-            arrow::err("dereference operator not allowed here", t->line);
+            arrow::err("dereference operator not allowed here", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (t->type != token_types::IDENTIFIER)
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("identifier expected", t->line);
+            arrow::err("identifier expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        token* ref_token = t;
-        std::string& identifier = t->content;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to comma
-        if (t->content != ",")
+        const token* ref_token = &tokens[t];
+        std::string identifier = std::string(tokens[t].content);
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to comma
+        if (tokens[t].op != opcodes::COMMA)
         {
-            arrow::err("comma expected", t->line);
+            arrow::err("comma expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to allocation quantity
-        if (os == operating_systems::WINDOWS)
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to allocation quantity
+        const token& quantity = tokens[t];
+        std::uint32_t size;
+        evaluation_state e = evaluate(t, size);
+        if (e == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        if (value_types::floating(fn().values[size]))
+        {
+            arrow::err("the size of reference '" + identifier + "' has to be an integer", quantity.line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        // untyped references are plain bytes, and sizes only known at run time are
+        // left to the program
+        long long bytes = 0;
+        int width = value_types::size(type);
+        bool known = typed && quantity.type == token_types::NUMERIC_LITERAL;
+        if (known)
+            std::from_chars(quantity.content.data(), quantity.content.data() + quantity.content.length(), bytes);
+        if (known && (bytes < width || bytes % width != 0))
         {
-            as.sr(current_scope->t->content)->alloc_delta(32);
-            as.external("GetProcessHeap");
-            as.external("HeapAlloc");
-            as.instruct(current_scope->t->content, "call GetProcessHeap");
-            as.instruct(current_scope->t->content, "mov rcx, rax");
-            as.instruct(current_scope->t->content, "mov rdx, 8");
-            evaluation_state e = evaluate(t, nullptr, false);
-            if (e == evaluation_states::SYNTAX_ERROR)
+            arrow::err("reference '" + identifier + "' has to be a multiple of " + std::to_string(width) + " bytes to hold its type", quantity.line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        std::uint32_t alignment = NO_VALUE;
+        if (t < tokens.size() && tokens[t].op == opcodes::COMMA)
+        {
+            if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to alignment
+            long long n = 0;
+            if (tokens[t].type == token_types::NUMERIC_LITERAL)
+                std::from_chars(tokens[t].content.data(), tokens[t].content.data() + tokens[t].content.length(), n);
+            if (n <= 0 || n > runtime::MAX_ALIGNMENT || (n & (n - 1)) != 0)
+            {
+                arrow::err("alignment has to be a power of two up to " + std::to_string(runtime::MAX_ALIGNMENT), tokens[t].line);
                 return evaluation_states::SYNTAX_ERROR;
-            as.instruct(current_scope->t->content, "mov r8, rax");
-            as.instruct(current_scope->t->content, "call HeapAlloc");
-            int& mutilator = as.sr(current_scope->t->content)->offset_mutilator;
-            symbol& sym = symbols[identifier] = { ref_token, current_scope, mutilator -= 8 };
-            as.instruct(current_scope->t->content, "mov qword [rbp + " + std::to_string(mutilator) + "], rax");
-            return evaluation_states::FOUND;
+            }
+            alignment = fn().emit(ir_ops::CONST, value_types::I64, NO_VALUE, NO_VALUE, n, tokens[t].line);
+            t++;
         }
-        arrow::err("unsupported operation for output operating system " + operating_systems::name(os));
-        return evaluation_states::SYNTAX_ERROR;
+        int slot = fn().slot(value_types::PTR, identifier);
+        fn().emit(ir_ops::ALLOC, value_types::VOID, size, alignment, slot, ref_token->line);
+        symbols[identifier] = { ref_token, current_scope, current_scope->function, slot, type };
+        return evaluation_states::FOUND;
     }
 
     evaluation_state parser::reference()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return reference(c);
     }
 
-    evaluation_state parser::copy(token*& t)
+    evaluation_state parser::copy(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "copy") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
-        if (t->content == "*")
+        if (tokens[t].op != opcodes::COPY) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
+        if (tokens[t].op == opcodes::ASTERISK)
         {
-            arrow::err("dereference operator not allowed here", t->line);
+            arrow::err("dereference operator not allowed here", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (t->type != token_types::IDENTIFIER)
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("identifier expected", t->line);
+            arrow::err("identifier expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        std::string& identifier = t->content;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to comma
-        if (t->content != ",")
+        std::size_t identifier = t;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to comma
+        if (tokens[t].op != opcodes::COMMA)
         {
-            arrow::err("comma expected", t->line);
+            arrow::err("comma expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to value to copy
-        evaluation_state e = evaluate(t, nullptr, false);
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to value to copy
+        symbol* sym;
+        if (reference_symbol(identifier, sym) == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        std::size_t value = t;
+        std::uint32_t v;
+        evaluation_state e = evaluate(t, v, false, value_types::floating(sym->type) ? sym->type : value_types::I64);
         if (e == evaluation_states::SYNTAX_ERROR)
             return evaluation_states::SYNTAX_ERROR;
-        if (symbols.find(identifier) == symbols.end())
-        {
-            arrow::err("symbol '" + identifier + "' is not defined", t->line);
+        if (!fits(value, sym->type) || !matches(v, sym->type, tokens[identifier].line))
             return evaluation_states::SYNTAX_ERROR;
-        }
-        symbol& sym = symbols[identifier];
-        as.instruct(current_scope->t->content, "mov rbx, qword [rbp + " + std::to_string(sym.offset) + ']');
-        as.instruct(current_scope->t->content, "mov qword [rbx], rax");
+        int line = tokens[identifier].line;
+        std::uint32_t p = fn().emit(ir_ops::LOAD_SLOT, value_types::PTR, NO_VALUE, NO_VALUE, sym->slot, line);
+        fn().emit(ir_ops::STORE, sym->type, p, v, 0, line);
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::copy()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return copy(c);
     }
 
-    evaluation_state parser::add(token*& t)
+    evaluation_state parser::add(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "add") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
-        evaluation_state e_left = evaluate(t, nullptr, false, true);
-        if (t->content != ",")
+        if (tokens[t].op != opcodes::ADD) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
+        int line = tokens[t].line;
+        location l;
+        if (locate(t, l) == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        if (check_eof(t)) return evaluation_states::SYNTAX_ERROR;
+        if (tokens[t].op != opcodes::COMMA)
         {
-            arrow::err("comma expected", t->line);
+            arrow::err("comma expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to value to copy
-        as.instruct(current_scope->t->content, "mov rbx, rax");
-        evaluation_state e_right = evaluate(t, nullptr, false);
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to value to copy
+        std::size_t value = t;
+        std::uint32_t v;
+        evaluation_state e_right = evaluate(t, v, false, value_types::floating(l.type) ? l.type : value_types::I64);
         if (e_right == evaluation_states::SYNTAX_ERROR)
             return evaluation_states::SYNTAX_ERROR;
-        as.instruct(current_scope->t->content, "add [rbx], rax");
+        if ((l.slot == -1 && !fits(value, l.type)) || !matches(v, l.type, line))
+            return evaluation_states::SYNTAX_ERROR;
+        // pointers of references move by whole bytes, memory adds at its own width
+        std::uint32_t sum = fn().emit(ir_ops::ADD, l.slot != -1 ? value_types::I64 : l.type, read(l, line), v, 0, line);
+        write(l, sum, line);
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::add()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return add(c);
     }
 
-    evaluation_state parser::set(token*& t)
+    evaluation_state parser::set(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "set") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
-        if (t->content == "*")
+        if (tokens[t].op != opcodes::SET) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
+        if (tokens[t].op == opcodes::ASTERISK)
         {
-            arrow::err("dereference operator not allowed here", t->line);
+            arrow::err("dereference operator not allowed here", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (t->type != token_types::IDENTIFIER)
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("identifier expected", t->line);
+            arrow::err("identifier expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        std::string& identifier = t->content;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to comma
-        if (t->content != ",")
+        std::size_t identifier = t;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to comma
+        if (tokens[t].op != opcodes::COMMA)
         {
-            arrow::err("comma expected", t->line);
+            arrow::err("comma expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR; // skip to value to copy
-        evaluation_state e = evaluate(t, nullptr, false);
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to value to copy
+        std::uint32_t v;
+        evaluation_state e = evaluate(t, v);
         if (e == evaluation_states::SYNTAX_ERROR)
             return evaluation_states::SYNTAX_ERROR;
-        if (symbols.find(identifier) == symbols.end())
-        {
-            arrow::err("symbol '" + identifier + "' is not defined", t->line);
+        symbol* sym;
+        if (reference_symbol(identifier, sym) == evaluation_states::SYNTAX_ERROR)
             return evaluation_states::SYNTAX_ERROR;
-        }
-        symbol& sym = symbols[identifier];
-        as.instruct(current_scope->t->content, "mov qword [rbp + " + std::to_string(sym.offset) + "], rax");
+        fn().emit(ir_ops::STORE_SLOT, value_types::PTR, v, NO_VALUE, sym->slot, tokens[identifier].line);
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::set()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return set(c);
     }
 
-    evaluation_state parser::pass(token*& t)
+    evaluation_state parser::pass(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "pass") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR;
-        token* c = t;
-        local_push_stack.push(c);
-        evaluation_state e = evaluate(t, nullptr, true);
+        if (tokens[t].op != opcodes::PASS) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR;
+        local_push_stack.push(t);
+        std::uint32_t v;
+        evaluation_state e = evaluate(t, v, true);
         if (e == evaluation_states::NEUTRAL)
         {
-            arrow::err("expression expected", t->line);
+            arrow::err("expression expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
         if (e == evaluation_states::SYNTAX_ERROR) return evaluation_states::SYNTAX_ERROR;
@@ -316,276 +479,403 @@ namespace arrow
 
     evaluation_state parser::pass()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return pass(c);
     }
 
-    evaluation_state parser::pull(token*& t)
+    evaluation_state parser::pull(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "pull") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR;
-        evaluation_state e = evaluate(t, nullptr, false, true);
-        as.instruct(current_scope->t->content, "mov rbx, qword [rbp + " + std::to_string(((as.sr(current_scope->t->content)->pulls++) * 8) + 16) + ']');
-        as.instruct(current_scope->t->content, "mov [rax], rbx");
+        if (tokens[t].op != opcodes::PULL) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR;
+        int line = tokens[t].line;
+        location l;
+        if (locate(t, l) == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        std::uint32_t v = fn().emit(ir_ops::PARAM, value_types::I64, NO_VALUE, NO_VALUE, fn().params++, line);
+        write(l, v, line);
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::pull()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return pull(c);
     }
 
-    evaluation_state parser::ret(token*& t)
+    evaluation_state parser::ret(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "ret") return evaluation_states::NEUTRAL;
-        evaluation_state e = evaluate(t = t->next, nullptr);
-        as.instruct(current_scope->t->content, "push rax");
-        as.sr(current_scope->t->content)->preserve_ret_value = true;
+        if (tokens[t].op != opcodes::RET) return evaluation_states::NEUTRAL;
+        int line = tokens[t].line;
+        std::uint32_t v;
+        evaluation_state e = evaluate(++t, v);
+        if (e == evaluation_states::FOUND)
+            fn().emit(ir_ops::RET, value_types::VOID, v, NO_VALUE, 0, line);
         return e;
     }
 
     evaluation_state parser::ret()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return ret(c);
     }
 
-    evaluation_state parser::call(token*& t)
+    evaluation_state parser::call(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "call") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next))
+        if (tokens[t].op != opcodes::CALL) return evaluation_states::NEUTRAL;
+        if (check_eof(++t))
             return evaluation_states::SYNTAX_ERROR;
-        if (t->type != token_types::IDENTIFIER)
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("identifier expected", t->line);
+            arrow::err("identifier expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (symbols.find(t->content) == symbols.end())
+        auto it = symbols.find(tokens[t].content);
+        if (it == symbols.end())
         {
-            arrow::err("symbol '" + t->content + "' is not defined", t->line);
+            arrow::err("symbol '" + std::string(tokens[t].content) + "' is not defined", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        std::string& identifier = t->content;
-        as.sr(current_scope->t->content)->alloc_delta(32);
-        symbol& sym = symbols[t->content];
-        while (!local_push_stack.empty())
+        if (it->second.slot != -1)
         {
-            token* et = local_push_stack.top();
-            evaluation_state e = evaluate(et, nullptr, false);
-            if (local_push_stack.size() > X64_CALLING_CONVENTION_REGISTERS.size())
-                as.instruct(current_scope->t->content, "push rax");
-            else
-                as.instruct(current_scope->t->content, "mov " + X64_CALLING_CONVENTION_REGISTERS[local_push_stack.size() - 1] + ", rax");
-            local_push_stack.pop();
+            arrow::err("symbol '" + std::string(tokens[t].content) + "' is not a label", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
         }
-        as.instruct(current_scope->t->content, "call " + identifier);
-        t = t->next;
+        // arguments are evaluated here rather than at each pass so they see the latest
+        // contents of their references
+        std::vector<std::size_t> arguments(local_push_stack.size());
+        for (std::size_t i = arguments.size(); i-- > 0; local_push_stack.pop())
+            arguments[i] = local_push_stack.top();
+        for (std::size_t i = 0; i < arguments.size(); i++)
+        {
+            std::uint32_t v;
+            if (evaluate(arguments[i], v) == evaluation_states::SYNTAX_ERROR)
+                return evaluation_states::SYNTAX_ERROR;
+            fn().emit(ir_ops::ARG, value_types::VOID, v, NO_VALUE, i, tokens[t].line);
+        }
+        last_result = fn().emit(ir_ops::CALL, value_types::I64, arguments.size(), NO_VALUE, module.name(tokens[t].content), tokens[t].line);
+        t++;
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::call()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return call(c);
     }
 
-    evaluation_state parser::del(token*& t)
+    evaluation_state parser::del(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "del") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next))
+        if (tokens[t].op != opcodes::DEL) return evaluation_states::NEUTRAL;
+        if (check_eof(++t))
             return evaluation_states::SYNTAX_ERROR;
-        if (t->type != token_types::IDENTIFIER)
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("identifier expected", t->line);
+            arrow::err("identifier expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        if (symbols.find(t->content) == symbols.end())
-        {
-            arrow::err("symbol '" + t->content + "' is not defined", t->line);
+        symbol* sym;
+        if (reference_symbol(t, sym) == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        fn().emit(ir_ops::FREE, value_types::VOID, NO_VALUE, NO_VALUE, sym->slot, tokens[t].line);
+        symbols.erase(std::string(tokens[t].content));
+        t++;
+        return evaluation_states::FOUND;
+    }
+
+    evaluation_state parser::del()
+    {
+        std::size_t& c = current;
+        return del(c);
+    }
+
+    // vadd, vmul and vcopy go over the memory of the first reference and their source
+    // together, vfill writes a value over it. the count is in elements of the first
+    // reference's type
+    evaluation_state parser::bulk(std::size_t& t)
+    {
+        if (check_eof(t, false)) return evaluation_states::NEUTRAL;
+        opcode op = tokens[t].op;
+        if (op != opcodes::VADD && op != opcodes::VMUL && op != opcodes::VFILL && op != opcodes::VCOPY) return evaluation_states::NEUTRAL;
+        bulk_op kind = op == opcodes::VADD ? bulk_ops::ADD : op == opcodes::VMUL ? bulk_ops::MUL : op == opcodes::VFILL ? bulk_ops::FILL : bulk_ops::COPY;
+        int line = tokens[t].line;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR; // skip to identifier and check eof
+        if (tokens[t].type != token_types::IDENTIFIER)
+        {
+            arrow::err("reference expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        as.sr(current_scope->t->content)->alloc_delta(32);
-        symbol& sym = symbols[t->content];
-        if (os == operating_systems::WINDOWS)
+        symbol* sym;
+        if (reference_symbol(t, sym) == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        std::uint32_t operands[3];
+        operands[0] = fn().emit(ir_ops::LOAD_SLOT, value_types::PTR, NO_VALUE, NO_VALUE, sym->slot, line);
+        t++;
+        for (int i = 1; i < 3; i++)
         {
-            as.external("GetProcessHeap");
-            as.external("HeapFree");
-            as.instruct(current_scope->t->content, "call GetProcessHeap");
-            as.instruct(current_scope->t->content, "mov rcx, rax");
-            as.instruct(current_scope->t->content, "mov rdx, 0");
-            as.instruct(current_scope->t->content, "mov r8, qword [rbp + " + std::to_string(sym.offset) + ']');
-            as.instruct(current_scope->t->content, "call HeapFree");
+            if (check_eof(t)) return evaluation_states::SYNTAX_ERROR;
+            if (tokens[t].op != opcodes::COMMA)
+            {
+                arrow::err("comma expected", tokens[t].line);
+                return evaluation_states::SYNTAX_ERROR;
+            }
+            if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR;
+            std::size_t value = t;
+            bool filled = i == 1 && kind == bulk_ops::FILL;
+            if (i == 1 && !filled && tokens[t].type == token_types::IDENTIFIER)
+            {
+                symbol* source;
+                if (reference_symbol(t, source) == evaluation_states::SYNTAX_ERROR)
+                    return evaluation_states::SYNTAX_ERROR;
+                if (source->type != sym->type)
+                {
+                    arrow::err("'" + std::string(tokens[t].content) + "' holds " + specifier(source->type) + " values, not " + specifier(sym->type) + " ones", tokens[t].line);
+                    return evaluation_states::SYNTAX_ERROR;
+                }
+            }
+            value_type type = filled ? sym->type : value_types::I64;
+            evaluation_state e = evaluate(t, operands[i], false, value_types::floating(type) ? type : value_types::I64);
+            if (e == evaluation_states::NEUTRAL)
+                arrow::err("expression expected", tokens[value].line);
+            if (e != evaluation_states::FOUND || !fits(value, type) || !matches(operands[i], type, tokens[value].line))
+                return evaluation_states::SYNTAX_ERROR;
         }
+        for (int i = 0; i < 3; i++)
+            fn().emit(ir_ops::ARG, value_types::VOID, operands[i], NO_VALUE, i, line);
+        fn().emit(ir_ops::BULK, sym->type, 3, NO_VALUE, kind, line);
+        return evaluation_states::FOUND;
+    }
+
+    evaluation_state parser::bulk()
+    {
+        std::size_t& c = current;
+        return bulk(c);
+    }
+
+    // reads the value stored at a location
+    std::uint32_t parser::read(location& l, int line)
+    {
+        if (l.slot != -1)
+            return fn().emit(ir_ops::LOAD_SLOT, value_types::PTR, NO_VALUE, NO_VALUE, l.slot, line);
+        return fn().emit(ir_ops::LOAD, l.type, l.address, NO_VALUE, 0, line);
+    }
+
+    void parser::write(location& l, std::uint32_t v, int line)
+    {
+        if (l.slot != -1)
+            fn().emit(ir_ops::STORE_SLOT, value_types::PTR, v, NO_VALUE, l.slot, line);
         else
+            fn().emit(ir_ops::STORE, l.type, l.address, v, 0, line);
+    }
+
+    // evaluates an operand that is written to. a bare reference names its own slot,
+    // every dereference moves one pointer further
+    evaluation_state parser::locate(std::size_t& t, location& l)
+    {
+        if (check_eof(t, false)) return evaluation_states::NEUTRAL;
+        int dereferences = 0;
+        for (; t < tokens.size() && tokens[t].op == opcodes::ASTERISK; t++)
+            dereferences++;
+        if (check_eof(t)) return evaluation_states::SYNTAX_ERROR;
+        if (tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("unsupported operation for output operating system " + operating_systems::name(os));
+            arrow::err("reference expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        symbols.erase(t->content);
-        t = t->next;
+        symbol* sym;
+        if (reference_symbol(t, sym) == evaluation_states::SYNTAX_ERROR)
+            return evaluation_states::SYNTAX_ERROR;
+        if (dereferences > 1 && sym->type != value_types::I64)
+        {
+            arrow::err("reference '" + std::string(tokens[t].content) + "' holds " + specifier(sym->type) + " values, not addresses", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        int line = tokens[t].line;
+        l = { sym->slot, NO_VALUE, value_types::PTR };
+        for (int i = 0; i < dereferences; i++)
+        {
+            std::uint32_t address = read(l, line);
+            l = { -1, address, i == 0 ? sym->type : value_types::I64 };
+        }
+        t++;
         return evaluation_states::FOUND;
     }
 
-    evaluation_state parser::del()
-    {
-        token*& c = current;
-        return del(c);
-    }
-
-    evaluation_state parser::evaluate(token*& t, symbol* dest, bool validate, bool mutilating)
+    evaluation_state parser::evaluate(std::size_t& t, std::uint32_t& value, bool validate, value_type literal)
     {
-        std::string location = dest != nullptr ? "[rbp + " + std::to_string(dest->offset) + ']' : "rax";
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
         int dereferences = 0;
-        for (; t != nullptr && t->content == "*"; t = t->next)
+        for (; t < tokens.size() && tokens[t].op == opcodes::ASTERISK; t++)
             dereferences++;
         if (check_eof(t)) return evaluation_states::SYNTAX_ERROR;
-        if (dereferences != 0 && t->type != token_types::IDENTIFIER)
+        if (dereferences != 0 && tokens[t].type != token_types::IDENTIFIER)
         {
-            arrow::err("attempt to dereference non-symbol", t->line);
+            arrow::err("attempt to dereference non-symbol", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        /*
-        if (t->content == "*")
+        // a type specifier in front of a number literal gives it that type. without one
+        // it takes the type literal, or double when it has a decimal point
+        value_type type = literal;
+        bool typed = tokens[t].type == token_types::TYPE_SPECIFIER;
+        if (typed)
         {
-            if (check_eof(t = t->next))
-                return evaluation_states::SYNTAX_ERROR;
-            if (t->type != token_types::IDENTIFIER)
+            type = specified_type(tokens[t]);
+            if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR;
+            if (tokens[t].type != token_types::NUMERIC_LITERAL)
             {
-                arrow::err("attempt to dereference non-symbol", t->line);
+                arrow::err("number literal expected after '" + std::string(tokens[t - 1].content) + "'", tokens[t].line);
                 return evaluation_states::SYNTAX_ERROR;
             }
-            if (symbols.find(t->content) == symbols.end())
-            {
-                arrow::err("symbol '" + t->content + "' is not defined", t->line);
+            if (!fits(t, type))
                 return evaluation_states::SYNTAX_ERROR;
-            }
-            symbol& sym = symbols[t->content];
-            if (!validate)
-            {
-                if (location == "rax")
-                {
-                    as.instruct(current_scope->t->content, "mov rax, qword [rbp + " + std::to_string(sym.offset) + ']');
-                    if (!mutilating)
-                        as.instruct(current_scope->t->content, "mov rax, qword [rax]");
-                }
-                else
-                {
-                    as.instruct(current_scope->t->content, "push rax");
-                    as.instruct(current_scope->t->content, "mov rax, qword [rbp + " + std::to_string(sym.offset) + ']');
-                    if (!mutilating)
-                        as.instruct(current_scope->t->content, "mov rax, qword [rax]");
-                    as.instruct(current_scope->t->content, "mov qword " + location + ", rax");
-                    as.instruct(current_scope->t->content, "pop rax");
-                }
-            }
-            t = t->next;
-            return evaluation_states::FOUND;
         }
-        */
-        if (!validate)
+        int line = tokens[t].line;
+        switch (tokens[t].type)
         {
-            switch (t->type)
+            case token_types::NUMERIC_LITERAL:
             {
-                case token_types::NUMERIC_LITERAL:
-                {
-                    as.instruct(current_scope->t->content, "mov " + location + ", " + t->content);
-                    break;
-                }
-                case token_types::STRING_LITERAL:
-                {
-                    as << arrow::data << 'L' + std::to_string(++literal_counter) + " db " + t->content + ", 0";
-                    as.instruct(current_scope->t->content, "mov " + location + ", " + 'L' + std::to_string(literal_counter));
-                    break;
-                }
-                case token_types::IDENTIFIER:
+                if (!typed && tokens[t].content.find('.') != std::string_view::npos)
+                    type = value_types::F64;
+                if (value_types::floating(type))
                 {
-                    if (symbols.find(t->content) == symbols.end())
+                    double d = 0;
+                    auto [end, ec] = std::from_chars(tokens[t].content.data(), tokens[t].content.data() + tokens[t].content.length(), d);
+                    if (ec != std::errc() || end != tokens[t].content.data() + tokens[t].content.length())
                     {
-                        arrow::err("symbol '" + t->content + "' is not defined", t->line);
+                        arrow::err("'" + std::string(tokens[t].content) + "' is not a valid number", tokens[t].line);
                         return evaluation_states::SYNTAX_ERROR;
                     }
-                    symbol& sym = symbols[t->content];
-                    if (location == "rax")
-                    {
-                        as.instruct(current_scope->t->content, std::string(!mutilating ? "mov" : "lea") + " rax, [rbp + " + std::to_string(sym.offset) + ']');
-                        for (int i = 0; i < dereferences; i++)
-                            as.instruct(current_scope->t->content, "mov rax, [rax]");
-                    }
+                    // the constant is the bits of the number at its own width
+                    std::int64_t bits = 0;
+                    float f = d;
+                    if (type == value_types::F32)
+                        std::memcpy(&bits, &f, sizeof(f));
                     else
-                    {
-                        as.instruct(current_scope->t->content, "push rax");
-                        as.instruct(current_scope->t->content, std::string(!mutilating ? "mov" : "lea") + " rax, [rbp + " + std::to_string(sym.offset) + ']');
-                        for (int i = 0; i < dereferences; i++)
-                            as.instruct(current_scope->t->content, "mov rax, [rax]");
-                        as.instruct(current_scope->t->content, "mov qword " + location + ", rax");
-                        as.instruct(current_scope->t->content, "pop rax");
-                    }
+                        std::memcpy(&bits, &d, sizeof(d));
+                    if (!validate)
+                        value = fn().emit(ir_ops::CONST, type, NO_VALUE, NO_VALUE, bits, line);
                     break;
                 }
-                default:
+                long long n = 0;
+                auto [end, ec] = std::from_chars(tokens[t].content.data(), tokens[t].content.data() + tokens[t].content.length(), n);
+                if (ec != std::errc() || end != tokens[t].content.data() + tokens[t].content.length())
                 {
-                    arrow::err("expected a symbol, string literal, or number literal", t->line);
+                    arrow::err("'" + std::string(tokens[t].content) + "' is not a valid integer", tokens[t].line);
                     return evaluation_states::SYNTAX_ERROR;
                 }
+                if (!validate)
+                    value = fn().emit(ir_ops::CONST, type, NO_VALUE, NO_VALUE, n, line);
+                break;
+            }
+            case token_types::STRING_LITERAL:
+            {
+                if (!validate)
+                    value = fn().emit(ir_ops::STRING, value_types::PTR, NO_VALUE, NO_VALUE, module.literal(tokens[t].content), line);
+                break;
+            }
+            case token_types::IDENTIFIER:
+            {
+                symbol* sym;
+                if (reference_symbol(t, sym) == evaluation_states::SYNTAX_ERROR)
+                    return evaluation_states::SYNTAX_ERROR;
+                if (dereferences > 1 && sym->type != value_types::I64)
+                {
+                    arrow::err("reference '" + std::string(tokens[t].content) + "' holds " + specifier(sym->type) + " values, not addresses", tokens[t].line);
+                    return evaluation_states::SYNTAX_ERROR;
+                }
+                if (!validate)
+                {
+                    location l = { sym->slot, NO_VALUE, value_types::PTR };
+                    value = read(l, line);
+                    for (int i = 0; i < dereferences; i++)
+                    {
+                        l = { -1, value, i == 0 ? sym->type : value_types::I64 };
+                        value = read(l, line);
+                    }
+                }
+                break;
+            }
+            default:
+            {
+                arrow::err("expected a symbol, string literal, or number literal", tokens[t].line);
+                return evaluation_states::SYNTAX_ERROR;
             }
         }
-        t = t->next;
+        t++;
         return evaluation_states::FOUND;
     }
 
-    evaluation_state parser::il_asm(token*& t)
+    evaluation_state parser::il_asm(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "asm") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR;
-        if (t->type != token_types::STRING_LITERAL)
+        if (tokens[t].op != opcodes::ASM) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR;
+        if (tokens[t].type != token_types::STRING_LITERAL)
         {
-            arrow::err("string literal expected", t->line);
+            arrow::err("string literal expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
-        as.instruct(current_scope->t->content, t->content.substr(1, t->content.length() - 2));
-        t = t->next;
+        int text = module.name(tokens[t].content.substr(1, tokens[t].content.length() - 2));
+        fn().emit(ir_ops::ASM, value_types::VOID, NO_VALUE, NO_VALUE, text, tokens[t].line);
+        t++;
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::il_asm()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return il_asm(c);
     }
 
-    evaluation_state parser::store(token*& t)
+    evaluation_state parser::store(std::size_t& t)
     {
         if (check_eof(t, false)) return evaluation_states::NEUTRAL;
-        if (t->content != "store") return evaluation_states::NEUTRAL;
-        if (check_eof(t = t->next)) return evaluation_states::SYNTAX_ERROR;
-        as.instruct(current_scope->t->content, "mov rbx, rax");
-        evaluation_state e = evaluate(t, nullptr, false, true);
+        if (tokens[t].op != opcodes::STORE) return evaluation_states::NEUTRAL;
+        if (check_eof(++t)) return evaluation_states::SYNTAX_ERROR;
+        if (last_result == NO_VALUE)
+        {
+            arrow::err("nothing to store, no call was made in this label yet", tokens[t].line);
+            return evaluation_states::SYNTAX_ERROR;
+        }
+        int line = tokens[t].line;
+        location l;
+        evaluation_state e = locate(t, l);
         if (e == evaluation_states::NEUTRAL)
         {
-            arrow::err("expression expected", t->line);
+            arrow::err("expression expected", tokens[t].line);
             return evaluation_states::SYNTAX_ERROR;
         }
         if (e == evaluation_states::SYNTAX_ERROR) return e;
-        as.instruct(current_scope->t->content, "mov [rax], rbx");
+        // externs hand floating point results back in a vector register, so the call
+        // learns what it returns from where the result goes
+        if (l.slot == -1 && value_types::floating(l.type) && fn().values[last_result] != l.type)
+        {
+            for (ir_block& block : fn().blocks)
+            {
+                for (ir_node& n : block.nodes)
+                {
+                    if (n.op == ir_ops::CALL && n.dst == last_result)
+                        n.type = l.type;
+                }
+            }
+            fn().values[last_result] = l.type;
+        }
+        write(l, last_result, line);
         return evaluation_states::FOUND;
     }
 
     evaluation_state parser::store()
     {
-        token*& c = current;
+        std::size_t& c = current;
         return store(c);
     }
 
-    std::string parser::result()
+    ir_module& parser::result()
     {
-        return as.construct();
+        return module;
     }
 
     bool parser::has_symbol(std::string name)
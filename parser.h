@@ -1,13 +1,15 @@
 #ifndef ARROW_PARSER_H
 #define ARROW_PARSER_H
 
+#include <array>
 #include <map>
 #include <stack>
 #include <string>
+#include <vector>
 
 #include "tokenization.h"
 #include "logger.h"
-#include "assembler.h"
+#include "ir.h"
 
 namespace arrow
 {
@@ -21,66 +23,81 @@ namespace arrow
         std::string name(evaluation_state es);
     }
 
-    typedef unsigned int operating_system;
-    namespace operating_systems
-    {
-        const operating_system WINDOWS = 0x00;
-        const operating_system MAC = 0x01;
-        const operating_system LINUX = 0x02;
-
-        std::string name(operating_system os);
-    }
-
     typedef struct symbol {
-        token* t;
+        const token* t;
         symbol* scope;
-        int offset;
+        int function; // function of a label, or the function owning a reference
+        int slot; // frame slot of a reference, -1 for labels and externs
+        value_type type; // what a reference points to, long when it was given no type
     } symbol;
 
+    // somewhere a value can be written to: a reference's own slot, or the memory
+    // at an address held in a value, type wide
+    typedef struct location {
+        int slot;
+        std::uint32_t address;
+        value_type type;
+    } location;
+
     class parser
     {
     private:
-        std::map<std::string, symbol> symbols;
-        token* current;
+        std::map<std::string, symbol, std::less<>> symbols;
+        std::vector<token>& tokens;
+        std::size_t current;
         symbol* current_scope;
-        assembler as;
-        operating_system os;
-        std::stack<token*> local_push_stack;
-        int literal_counter;
-        int arguments;
+        ir_module module;
+        std::stack<std::size_t> local_push_stack;
+        std::uint32_t last_result;
+        std::size_t statements;
+        bool check_eof(std::size_t t, bool msg = true);
+        ir_function& fn();
+        evaluation_state reference_symbol(std::size_t t, symbol*& sym);
+        bool fits(std::size_t t, value_type type);
+        bool matches(std::uint32_t v, value_type type, int line);
+        std::uint32_t read(location& l, int line);
+        void write(location& l, std::uint32_t v, int line);
     public:
-        parser(token* start, operating_system os);
+        typedef evaluation_state (parser::*handler)(std::size_t& t);
+
+        parser(std::vector<token>& tokens);
         bool good();
-        evaluation_state label_start(token*& t);
+        evaluation_state statement(std::size_t& t);
+        evaluation_state statement();
+        std::size_t statement_count();
+        evaluation_state label_start(std::size_t& t);
         evaluation_state label_start();
-        evaluation_state label_end(token*& t);
+        evaluation_state label_end(std::size_t& t);
         evaluation_state label_end();
-        evaluation_state define(token*& t);
+        evaluation_state define(std::size_t& t);
         evaluation_state define();
-        evaluation_state reference(token*& t);
+        evaluation_state reference(std::size_t& t);
         evaluation_state reference();
-        evaluation_state evaluate(token*& t, symbol* dest, bool validate = false, bool mutilating = false);
-        evaluation_state copy(token*& t);
+        evaluation_state evaluate(std::size_t& t, std::uint32_t& value, bool validate = false, value_type literal = value_types::I64);
+        evaluation_state locate(std::size_t& t, location& l);
+        evaluation_state copy(std::size_t& t);
         evaluation_state copy();
-        evaluation_state add(token*& t);
+        evaluation_state add(std::size_t& t);
         evaluation_state add();
-        evaluation_state set(token*& t);
+        evaluation_state set(std::size_t& t);
         evaluation_state set();
-        evaluation_state pass(token*& t);
+        evaluation_state pass(std::size_t& t);
         evaluation_state pass();
-        evaluation_state pull(token*& t);
+        evaluation_state pull(std::size_t& t);
         evaluation_state pull();
-        evaluation_state ret(token*& t);
+        evaluation_state ret(std::size_t& t);
         evaluation_state ret();
-        evaluation_state call(token*& t);
+        evaluation_state call(std::size_t& t);
         evaluation_state call();
-        evaluation_state del(token*& t);
+        evaluation_state del(std::size_t& t);
         evaluation_state del();
-        evaluation_state il_asm(token*& t);
+        evaluation_state il_asm(std::size_t& t);
         evaluation_state il_asm();
-        evaluation_state store(token*& t);
+        evaluation_state store(std::size_t& t);
         evaluation_state store();
-        std::string result();
+        evaluation_state bulk(std::size_t& t);
+        evaluation_state bulk();
+        ir_module& result();
         bool has_symbol(std::string name);
     };
 }
@@ -0,0 +1,713 @@
+#include <array>
+#include <algorithm>
+#include <charconv>
+
+#include "peephole.h"
+
+namespace arrow
+{
+    // how many instructions a rule looks past before giving up
+    const std::size_t WINDOW = 32;
+
+    // register families, in the order of the register table
+    const int RAX = 0, RBX = 1, RCX = 2, RDX = 3, RSI = 4, RDI = 5, RBP = 6, RSP = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15;
+    const int FAMILIES = 16;
+
+    unsigned int bit(int family)
+    {
+        return family == -1 ? 0 : 1u << family;
+    }
+
+    // of every convention, including the one labels call each other with
+    const unsigned int ARGUMENT_REGISTERS = bit(RCX) | bit(RDX) | bit(R8) | bit(R9) | bit(R10) | bit(R11) | bit(RSI) | bit(RDI);
+    const unsigned int VOLATILE_REGISTERS = bit(RAX) | bit(RCX) | bit(RDX) | bit(R8) | bit(R9) | bit(R10) | bit(R11);
+    // what the caller expects back unchanged, so a ret reads them
+    const unsigned int PRESERVED_REGISTERS = bit(RBX) | bit(RBP) | bit(RSI) | bit(RDI) | bit(R12) | bit(R13) | bit(R14) | bit(R15);
+    const unsigned int ALL_REGISTERS = (1u << FAMILIES) - 1;
+
+    bool deleted(const instruction& in)
+    {
+        return !in.raw && in.mnemonic.empty();
+    }
+
+    std::size_t next(const std::vector<instruction>& code, std::size_t i)
+    {
+        for (i++; i < code.size() && deleted(code[i]); i++);
+        return i;
+    }
+
+    // code.size() when there is nothing before i
+    std::size_t previous(const std::vector<instruction>& code, std::size_t i)
+    {
+        while (i > 0)
+        {
+            if (!deleted(code[--i]))
+                return i;
+        }
+        return code.size();
+    }
+
+    bool is_memory(const std::string& operand)
+    {
+        return operand.find('[') != std::string::npos;
+    }
+
+    // integers that fit the sign extended 32-bit immediate of a move into memory
+    bool is_immediate(const std::string& operand)
+    {
+        long long n = 0;
+        auto [end, ec] = std::from_chars(operand.data(), operand.data() + operand.length(), n);
+        return ec == std::errc() && end == operand.data() + operand.length() && n >= INT32_MIN && n <= INT32_MAX;
+    }
+
+    // immediates that fit an operand of size bytes, read either signed or unsigned
+    bool fits_width(const std::string& operand, int size)
+    {
+        long long n = 0;
+        std::from_chars(operand.data(), operand.data() + operand.length(), n);
+        return n >= -(1LL << (size * 8 - 1)) && n < (1LL << size * 8);
+    }
+
+    bool is_word(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z');
+    }
+
+    // the register families an operand names anywhere, addresses included
+    unsigned int registers_in(const std::string& operand)
+    {
+        unsigned int mask = 0;
+        std::size_t i = 0;
+        while (i < operand.length())
+        {
+            if (!is_word(operand[i]))
+            {
+                i++;
+                continue;
+            }
+            std::size_t start = i;
+            while (i < operand.length() && is_word(operand[i]))
+                i++;
+            if (i - start <= 4 && (operand[start] < '0' || operand[start] > '9')) // no register name is longer
+                mask |= bit(register_family(std::string_view(operand).substr(start, i - start)));
+        }
+        return mask;
+    }
+
+    // scalar sse instructions, which write their first operand
+    const char* VECTOR_MNEMONICS[] = {
+        "movd", "movq", "movss", "movsd", "addss", "addsd", "subss", "subsd", "mulss", "mulsd", "divss", "divsd",
+        "minss", "minsd", "maxss", "maxsd", "sqrtss", "sqrtsd", "cvtss2sd", "cvtsd2ss"
+    };
+
+    namespace mnemonic_kinds
+    {
+        mnemonic_kind classify(const instruction& in)
+        {
+            if (in.raw)
+                return UNKNOWN;
+            std::string_view m = in.mnemonic;
+            if (m.empty())
+                return DELETED;
+            if (m == "mov") return MOV;
+            if (m == "movsx" || m == "movsxd" || m == "movzx") return EXTEND;
+            if (m == "lea") return LEA;
+            if (m == "add") return ADD;
+            if (m == "sub") return SUB;
+            if (m == "push") return PUSH;
+            if (m == "pop") return POP;
+            if (m == "xchg") return XCHG;
+            if (m == "call") return CALL;
+            if (m == "ret") return RET;
+            if (m == "test" || m == "cmp") return COMPARE;
+            for (const char* vector : VECTOR_MNEMONICS)
+            {
+                if (m == vector && in.operands.size() == 2) // movsd without operands is the string move
+                    return VECTOR;
+            }
+            // jumps inside a subroutine only ever go to its local labels
+            if (m == "jmp" && in.operands.size() == 1 && in.operands[0].front() != '.' && register_family(in.operands[0]) == -1 && !is_memory(in.operands[0]))
+                return TAIL;
+            if (m.front() == 'j' || m.back() == ':') return BRANCH;
+            return UNKNOWN;
+        }
+    }
+
+    // whether the rules have to assume the instruction reads and writes everything
+    bool opaque(mnemonic_kind kind)
+    {
+        return kind == mnemonic_kinds::UNKNOWN || kind == mnemonic_kinds::BRANCH;
+    }
+
+    // instructions that never read their first operand when it is a register
+    bool writes_first_only(mnemonic_kind kind)
+    {
+        return kind == mnemonic_kinds::MOV || kind == mnemonic_kinds::LEA || kind == mnemonic_kinds::POP || kind == mnemonic_kinds::EXTEND ||
+            kind == mnemonic_kinds::VECTOR;
+    }
+
+    unsigned int reads(const instruction& in, mnemonic_kind kind)
+    {
+        if (opaque(kind))
+            return ALL_REGISTERS;
+        if (kind == mnemonic_kinds::RET)
+            return bit(RAX) | bit(RSP) | PRESERVED_REGISTERS;
+        if (kind == mnemonic_kinds::TAIL)
+            return ARGUMENT_REGISTERS | bit(RSP) | PRESERVED_REGISTERS;
+        unsigned int mask = 0;
+        if (kind == mnemonic_kinds::CALL)
+            mask |= ARGUMENT_REGISTERS | bit(RAX) | bit(RSP); // al counts the vector arguments of a sysv variadic call
+        if (kind == mnemonic_kinds::PUSH || kind == mnemonic_kinds::POP)
+            mask |= bit(RSP);
+        for (std::size_t o = 0; o < in.operands.size(); o++)
+        {
+            if (o != 0 || !writes_first_only(kind) || is_memory(in.operands[0]))
+                mask |= registers_in(in.operands[o]);
+        }
+        return mask;
+    }
+
+    unsigned int writes(const instruction& in, mnemonic_kind kind)
+    {
+        if (opaque(kind))
+            return ALL_REGISTERS;
+        if (kind == mnemonic_kinds::CALL)
+            return VOLATILE_REGISTERS | bit(RSI) | bit(RDI) | bit(RSP);
+        if (kind == mnemonic_kinds::RET || kind == mnemonic_kinds::TAIL)
+            return 0;
+        if (kind == mnemonic_kinds::PUSH)
+            return bit(RSP);
+        if (kind == mnemonic_kinds::COMPARE)
+            return 0;
+        unsigned int mask = kind == mnemonic_kinds::POP ? bit(RSP) : 0;
+        for (std::size_t o = 0; o < in.operands.size(); o++)
+        {
+            if (o == 0 || kind == mnemonic_kinds::XCHG)
+                mask |= bit(register_family(in.operands[o]));
+        }
+        return mask;
+    }
+
+    unsigned int kills(const instruction& in, mnemonic_kind kind)
+    {
+        if (kind == mnemonic_kinds::CALL)
+            return VOLATILE_REGISTERS;
+        if (writes_first_only(kind) && in.operands.size() != 0 && register_size(in.operands[0]) >= 4)
+            return bit(register_family(in.operands[0]));
+        return 0;
+    }
+
+    // reads a memory operand such as qword [rbp + -8]
+    memory_operand memory_of(const std::string& operand)
+    {
+        memory_operand m = { false, false, false, 0, 0 };
+        std::string_view view = operand;
+        std::size_t open = view.find('['), close = view.find(']');
+        if (open == std::string_view::npos || close == std::string_view::npos)
+            return m;
+        m.present = true;
+        std::string_view prefix = view.substr(0, open), address = view.substr(open + 1, close - open - 1);
+        auto skip = [&]()
+        {
+            while (!address.empty() && address.front() == ' ')
+                address.remove_prefix(1);
+            while (!address.empty() && address.back() == ' ')
+                address.remove_suffix(1);
+        };
+        skip();
+        if (address.substr(0, 3) == "rsp")
+        {
+            m.stack = true;
+            return m;
+        }
+        if (address.substr(0, 3) != "rbp")
+            return m;
+        address.remove_prefix(3);
+        skip();
+        m.size = prefix.substr(0, 4) == "byte" ? 1 : prefix.substr(0, 4) == "word" ? 2 : prefix.substr(0, 5) == "dword" ? 4 : 8;
+        if (address.empty())
+        {
+            m.frame = true;
+            return m;
+        }
+        bool negative = address.front() == '-';
+        if (address.front() != '+' && address.front() != '-')
+            return m;
+        address.remove_prefix(1);
+        skip();
+        auto [end, ec] = std::from_chars(address.data(), address.data() + address.length(), m.start);
+        if (ec != std::errc() || end != address.data() + address.length())
+            return m;
+        if (negative)
+            m.start = -m.start;
+        m.frame = true;
+        return m;
+    }
+
+    instruction_effects effects_of(const instruction& in)
+    {
+        mnemonic_kind kind = mnemonic_kinds::classify(in);
+        if (kind == mnemonic_kinds::DELETED)
+            return { kind, 0, 0, 0, {}, {} };
+        instruction_effects e = { kind, reads(in, kind), writes(in, kind), kills(in, kind), {}, {} };
+        if (opaque(kind) || kind == mnemonic_kinds::LEA)
+            return e;
+        for (std::size_t o = 0; o < in.operands.size(); o++)
+        {
+            if (!is_memory(in.operands[o]))
+                continue;
+            memory_operand m = memory_of(in.operands[o]);
+            if (o == 0 && kind != mnemonic_kinds::PUSH && kind != mnemonic_kinds::COMPARE)
+                e.written = m;
+            if (o != 0 || !writes_first_only(kind))
+                e.read = m;
+        }
+        return e;
+    }
+
+    bool is_move(const peephole_code& pc, std::size_t i)
+    {
+        return pc.effects[i].kind == mnemonic_kinds::MOV && pc.code[i].operands.size() == 2;
+    }
+
+    // refreshes the effects of an instruction a rule changed
+    void update(peephole_code& pc, std::size_t i)
+    {
+        pc.effects[i] = effects_of(pc.code[i]);
+    }
+
+    void erase(peephole_code& pc, std::size_t i)
+    {
+        pc.code[i].mnemonic.clear();
+        pc.code[i].operands.clear();
+        update(pc, i);
+    }
+
+    bool may_alias(const memory_operand& a, const memory_operand& b, bool frame_escapes)
+    {
+        if (!a.present || !b.present)
+            return false;
+        if (a.frame && b.frame)
+            return a.start < b.start + b.size && b.start < a.start + a.size;
+        if (a.frame || b.frame)
+            return (a.frame ? b : a).stack ? false : frame_escapes; // the outgoing argument area sits below the frame's slots
+        return true;
+    }
+
+    // calls can reach anything but a frame that never escaped
+    bool call_reaches(const memory_operand& m, bool frame_escapes)
+    {
+        return !m.frame || frame_escapes;
+    }
+
+    bool reads_memory(const peephole_code& pc, std::size_t i, const memory_operand& m)
+    {
+        const instruction_effects& e = pc.effects[i];
+        if (opaque(e.kind))
+            return true;
+        if (e.kind == mnemonic_kinds::CALL)
+            return call_reaches(m, pc.frame_escapes);
+        return may_alias(e.read, m, pc.frame_escapes) || (e.kind == mnemonic_kinds::XCHG && may_alias(e.written, m, pc.frame_escapes));
+    }
+
+    bool writes_memory(const peephole_code& pc, std::size_t i, const memory_operand& m)
+    {
+        const instruction_effects& e = pc.effects[i];
+        if (opaque(e.kind))
+            return true;
+        if (e.kind == mnemonic_kinds::CALL)
+            return call_reaches(m, pc.frame_escapes);
+        return may_alias(e.written, m, pc.frame_escapes) || (e.kind == mnemonic_kinds::XCHG && may_alias(e.read, m, pc.frame_escapes));
+    }
+
+    // whether anything could hold an address inside the frame other than rbp and rsp
+    bool frame_escapes(const peephole_code& pc)
+    {
+        for (std::size_t i = 0; i < pc.code.size(); i++)
+        {
+            const instruction& in = pc.code[i];
+            mnemonic_kind kind = pc.effects[i].kind;
+            if (kind == mnemonic_kinds::UNKNOWN)
+                return true;
+            if (kind == mnemonic_kinds::LEA)
+            {
+                if (in.operands.size() == 2 && (registers_in(in.operands[1]) & (bit(RBP) | bit(RSP))))
+                    return true;
+                continue;
+            }
+            for (std::size_t o = 0; o < in.operands.size(); o++)
+            {
+                int family = register_family(in.operands[o]);
+                if (family != RBP && family != RSP)
+                    continue;
+                // pushing and popping rbp, moving rsp and setting up either is all the frame itself does
+                int target = register_family(in.operands[0]);
+                bool frame_setup = kind == mnemonic_kinds::PUSH || kind == mnemonic_kinds::POP ||
+                    (o == 0 && (kind == mnemonic_kinds::ADD || kind == mnemonic_kinds::SUB)) ||
+                    (kind == mnemonic_kinds::MOV && (target == RBP || target == RSP));
+                if (!frame_setup)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // whether the instruction leaves the subroutine
+    bool leaves(const peephole_code& pc, std::size_t i)
+    {
+        return pc.effects[i].kind == mnemonic_kinds::RET || pc.effects[i].kind == mnemonic_kinds::TAIL;
+    }
+
+    // whether nothing reads the register after instruction i before it is replaced
+    bool dead_after(const peephole_code& pc, std::size_t i, int family)
+    {
+        std::size_t j = i;
+        for (std::size_t n = 0; n < WINDOW; n++)
+        {
+            j = next(pc.code, j);
+            if (j == pc.code.size())
+                return false;
+            if (pc.effects[j].reads & bit(family))
+                return false;
+            if ((pc.effects[j].kills & bit(family)) || leaves(pc, j))
+                return true;
+        }
+        return false;
+    }
+
+    // mov r, r
+    bool self_move(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        if (!is_move(pc, i) || in.operands[0] != in.operands[1] || register_size(in.operands[0]) != 8)
+            return false;
+        erase(pc, i);
+        return true;
+    }
+
+    // push x straight into pop y
+    bool push_pop(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        if (pc.effects[i].kind != mnemonic_kinds::PUSH || in.operands.size() != 1)
+            return false;
+        std::size_t j = next(pc.code, i);
+        if (j == pc.code.size() || pc.effects[j].kind != mnemonic_kinds::POP || pc.code[j].operands.size() != 1)
+            return false;
+        std::string from = in.operands[0], to = pc.code[j].operands[0];
+        if (is_memory(from) && is_memory(to) && from != to)
+            return false;
+        if (from == to)
+            erase(pc, j);
+        else
+        {
+            pc.code[j] = { "mov", { to, from }, false };
+            update(pc, j);
+        }
+        erase(pc, i);
+        return true;
+    }
+
+    // a load of memory that a register or constant written to it still holds
+    bool repeated_load(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        if (!is_move(pc, i) || !pc.effects[i].read.present || register_size(in.operands[0]) == 0)
+            return false;
+        const std::string& m = in.operands[1];
+        const memory_operand& memory = pc.effects[i].read;
+        int size = register_size(in.operands[0]);
+        unsigned int address = registers_in(m);
+        unsigned int written = 0; // register families changed between j and i
+        std::size_t j = i;
+        for (std::size_t n = 0; n < WINDOW; n++)
+        {
+            j = previous(pc.code, j);
+            if (j == pc.code.size() || opaque(pc.effects[j].kind) || leaves(pc, j))
+                return false;
+            instruction& before = pc.code[j];
+            const std::string* held = nullptr;
+            bool loaded = false;
+            if (is_move(pc, j) && before.operands[0] == m && !is_memory(before.operands[1]))
+                held = &before.operands[1];
+            else if (is_move(pc, j) && before.operands[1] == m && register_size(before.operands[0]) != 0)
+            {
+                held = &before.operands[0];
+                loaded = true;
+            }
+            if (held != nullptr)
+            {
+                int family = register_family(*held);
+                if (family == -1 && !is_immediate(*held))
+                    return false;
+                if (family != -1 && (register_size(*held) != size || (written & bit(family)) || (loaded && (address & bit(family)))))
+                    return false;
+                if (*held == in.operands[0])
+                    erase(pc, i);
+                else
+                {
+                    in.operands[1] = *held;
+                    update(pc, i);
+                }
+                return true;
+            }
+            if (pc.effects[j].writes & address)
+                return false; // the address itself changed
+            written |= pc.effects[j].writes;
+            if (writes_memory(pc, j, memory))
+                return false;
+        }
+        return false;
+    }
+
+    // mov r, x straight into mov y, r when nothing needs r afterwards
+    bool forward_move(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        if (!is_move(pc, i) || register_size(in.operands[0]) != 8)
+            return false;
+        int family = register_family(in.operands[0]);
+        if (family == RSP || family == RBP)
+            return false;
+        std::size_t j = next(pc.code, i);
+        if (j == pc.code.size() || !is_move(pc, j) || pc.code[j].operands[1] != in.operands[0] || (registers_in(pc.code[j].operands[0]) & bit(family)))
+            return false;
+        const std::string& from = in.operands[1];
+        const std::string& to = pc.code[j].operands[0];
+        if (is_memory(to) && (is_memory(from) || (register_size(from) == 0 && !(is_immediate(from) && to.find("qword") == 0))))
+            return false;
+        if (!is_memory(to) && register_size(to) != 8)
+            return false;
+        if (!dead_after(pc, j, family))
+            return false;
+        pc.code[j].operands[1] = from;
+        update(pc, j);
+        erase(pc, i);
+        return true;
+    }
+
+    // a register write nothing reads before it is replaced
+    bool dead_move(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        mnemonic_kind kind = pc.effects[i].kind;
+        if ((kind != mnemonic_kinds::MOV && kind != mnemonic_kinds::LEA && kind != mnemonic_kinds::EXTEND) || in.operands.size() != 2 || register_size(in.operands[0]) < 4)
+            return false;
+        int family = register_family(in.operands[0]);
+        if (family == RSP || family == RBP || !dead_after(pc, i, family))
+            return false;
+        erase(pc, i);
+        return true;
+    }
+
+    // a frame slot write nothing reads before the slot is overwritten or the subroutine returns
+    bool dead_store(peephole_code& pc, std::size_t i)
+    {
+        const memory_operand slot = pc.effects[i].written;
+        if (pc.frame_escapes || !is_move(pc, i) || !slot.frame || slot.start >= 0)
+            return false;
+        std::size_t j = i;
+        for (std::size_t n = 0; n < WINDOW; n++)
+        {
+            j = next(pc.code, j);
+            if (j == pc.code.size() || reads_memory(pc, j, slot))
+                return false;
+            const memory_operand& over = pc.effects[j].written;
+            bool overwritten = is_move(pc, j) && over.frame && over.start <= slot.start && slot.start + slot.size <= over.start + over.size;
+            if (leaves(pc, j) || overwritten)
+            {
+                erase(pc, i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // a load, an add to what was loaded and a store back to the same memory, as one
+    // add to the memory. the width of the store is the width of the add
+    bool read_modify_write(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        mnemonic_kind kind = pc.effects[i].kind;
+        if ((kind != mnemonic_kinds::MOV && kind != mnemonic_kinds::EXTEND) || in.operands.size() != 2 || !is_memory(in.operands[1]) || register_size(in.operands[0]) != 8)
+            return false;
+        const std::string& reg = in.operands[0];
+        const std::string& memory = in.operands[1];
+        int family = register_family(reg);
+        std::size_t j = next(pc.code, i);
+        if (j == pc.code.size() || pc.effects[j].kind != mnemonic_kinds::ADD || pc.code[j].operands.size() != 2 || pc.code[j].operands[0] != reg)
+            return false;
+        std::size_t k = next(pc.code, j);
+        if (k == pc.code.size() || !is_move(pc, k) || pc.code[k].operands[0] != memory || register_family(pc.code[k].operands[1]) != family)
+            return false;
+        const std::string& addend = pc.code[j].operands[1];
+        int size = register_size(pc.code[k].operands[1]);
+        if (is_memory(addend) || (register_family(addend) != -1 && register_size(addend) != 8) || (registers_in(memory) & bit(family)) || (registers_in(addend) & bit(family)))
+            return false;
+        std::string operand = addend;
+        if (register_size(addend) == 8)
+            operand = resolve_register(addend, size);
+        else if (!is_immediate(addend) || (size < 4 && !fits_width(addend, size)))
+            return false;
+        if (!dead_after(pc, k, family))
+            return false;
+        pc.code[k] = { "add", { memory, operand }, false };
+        update(pc, k);
+        erase(pc, j);
+        erase(pc, i);
+        return true;
+    }
+
+    // a value on its way between memory and a vector register through an integer
+    // register, as one scalar move: a load into r then movq or movd from r, or movq or
+    // movd into r then a store of r
+    bool vector_memory(peephole_code& pc, std::size_t i)
+    {
+        instruction& in = pc.code[i];
+        std::size_t j = next(pc.code, i);
+        if (j == pc.code.size() || in.operands.size() != 2 || pc.code[j].operands.size() != 2)
+            return false;
+        instruction& after = pc.code[j];
+        bool load = (is_move(pc, i) || in.mnemonic == "movsxd") && is_memory(in.operands[1]) && (after.mnemonic == "movq" || after.mnemonic == "movd") &&
+            !is_memory(after.operands[0]) && register_family(after.operands[0]) == -1;
+        bool store = (in.mnemonic == "movq" || in.mnemonic == "movd") && register_family(in.operands[1]) == -1 && !is_memory(in.operands[1]) &&
+            is_move(pc, j) && is_memory(after.operands[0]);
+        const std::string& bits = load ? in.operands[0] : after.operands[1];
+        const std::string& moved = load ? after.operands[1] : in.operands[0];
+        int family = register_family(bits);
+        if ((!load && !store) || family == -1 || register_family(moved) != family)
+            return false;
+        bool single = (load ? after.mnemonic : in.mnemonic) == "movd";
+        std::string memory = load ? in.operands[1] : after.operands[0];
+        // a double needs all of the memory, a float only its low dword
+        if (memory.find("qword") != 0 && (memory.find("dword") != 0 || !single))
+            return false;
+        if (store && register_size(bits) != (single ? 4 : 8))
+            return false;
+        if ((registers_in(memory) & bit(family)) || !dead_after(pc, j, family))
+            return false;
+        if (single)
+            memory = "dword" + memory.substr(memory.find(' '));
+        std::string xmm = load ? after.operands[0] : in.operands[1];
+        std::string mnemonic = single ? "movss" : "movsd";
+        pc.code[j] = load ? instruction { mnemonic, { xmm, memory }, false } : instruction { mnemonic, { memory, xmm }, false };
+        update(pc, j);
+        erase(pc, i);
+        return true;
+    }
+
+    bool is(const instruction& in, const char* mnemonic, std::initializer_list<const char*> operands)
+    {
+        if (in.raw || in.mnemonic != mnemonic || in.operands.size() != operands.size())
+            return false;
+        std::size_t o = 0;
+        for (const char* operand : operands)
+        {
+            if (operand != nullptr && in.operands[o] != operand)
+                return false;
+            o++;
+        }
+        return true;
+    }
+
+    // the frame of a subroutine whose body never touches rbp or rsp, such as a leaf
+    // that keeps everything in registers once its stores are gone. i is where the
+    // subroutine starts, and its end is a ret or the jmp of a tail call
+    bool unused_frame(peephole_code& pc, std::size_t i)
+    {
+        if (previous(pc.code, i) != pc.code.size() || !is(pc.code[i], "push", { "rbp" }))
+            return false;
+        std::vector<std::size_t> live;
+        for (std::size_t j = i; j < pc.code.size(); j = next(pc.code, j))
+            live.push_back(j);
+        std::size_t first = 2, last = live.size() - 2;
+        if (live.size() < 4 || !is(pc.code[live[1]], "mov", { "rbp", "rsp" }) || !is(pc.code[live[last]], "pop", { "rbp" }))
+            return false;
+        if (!leaves(pc, live.back()))
+            return false;
+        if (is(pc.code[live[first]], "sub", { "rsp", nullptr }))
+            first++;
+        if (last > first && is(pc.code[live[last - 1]], "add", { "rsp", nullptr }))
+            last--;
+        for (std::size_t k = first; k < last; k++)
+        {
+            const instruction_effects& e = pc.effects[live[k]];
+            if (opaque(e.kind) || ((e.reads | e.writes) & (bit(RBP) | bit(RSP))))
+                return false;
+        }
+        for (std::size_t k = 0; k < live.size() - 1; k++)
+        {
+            if (k < first || k >= last)
+                erase(pc, live[k]);
+        }
+        return true;
+    }
+
+    const std::array<peephole_rule, 9> RULES = {{
+        { "self_move", self_move },
+        { "push_pop", push_pop },
+        { "repeated_load", repeated_load },
+        { "forward_move", forward_move },
+        { "dead_move", dead_move },
+        { "dead_store", dead_store },
+        { "read_modify_write", read_modify_write },
+        { "vector_memory", vector_memory },
+        { "unused_frame", unused_frame }
+    }};
+
+    peephole::peephole()
+    {
+        fired.assign(RULES.size(), 0);
+        removed = 0;
+    }
+
+    void peephole::run(std::vector<instruction>& code)
+    {
+        peephole_code pc = { code, {}, false };
+        for (instruction& in : code)
+            pc.effects.push_back(effects_of(in));
+        pc.frame_escapes = frame_escapes(pc);
+        std::size_t before = code.size();
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (std::size_t i = 0; i < code.size(); i++)
+            {
+                for (std::size_t r = 0; r < RULES.size() && !deleted(code[i]); r++)
+                {
+                    if (RULES[r].rewrite(pc, i))
+                    {
+                        fired[r]++;
+                        changed = true;
+                    }
+                }
+            }
+            if (!changed)
+                break;
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < code.size(); i++)
+            {
+                if (deleted(code[i]))
+                    continue;
+                if (kept != i)
+                {
+                    code[kept] = std::move(code[i]);
+                    pc.effects[kept] = pc.effects[i];
+                }
+                kept++;
+            }
+            code.resize(kept);
+            pc.effects.resize(kept);
+        }
+        removed += before - code.size();
+    }
+
+    std::string peephole::report()
+    {
+        std::string str = "peephole removed " + std::to_string(removed) + " instructions (";
+        for (std::size_t r = 0; r < RULES.size(); r++)
+            str += std::string(r == 0 ? "" : ", ") + RULES[r].name + ' ' + std::to_string(fired[r]);
+        return str + ')';
+    }
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef ARROW_PEEPHOLE_H
+#define ARROW_PEEPHOLE_H
+
+#include <string>
+#include <vector>
+
+#include "assembler.h"
+
+namespace arrow
+{
+    // the mnemonics the rules know the effects of. anything else stops them
+    typedef unsigned int mnemonic_kind;
+    namespace mnemonic_kinds
+    {
+        const mnemonic_kind UNKNOWN = 0x00;
+        const mnemonic_kind MOV = 0x01;
+        const mnemonic_kind LEA = 0x02;
+        const mnemonic_kind ADD = 0x03;
+        const mnemonic_kind SUB = 0x04;
+        const mnemonic_kind PUSH = 0x05;
+        const mnemonic_kind POP = 0x06;
+        const mnemonic_kind XCHG = 0x07;
+        const mnemonic_kind CALL = 0x08;
+        const mnemonic_kind RET = 0x09;
+        const mnemonic_kind DELETED = 0x0A;
+        const mnemonic_kind COMPARE = 0x0B; // test and cmp, which only set flags
+        const mnemonic_kind BRANCH = 0x0C; // jumps and labels, where the rules lose track of the state
+        const mnemonic_kind TAIL = 0x0D; // jmp to another subroutine, which leaves this one like a ret
+        const mnemonic_kind EXTEND = 0x0E; // movsx, movsxd and movzx
+        const mnemonic_kind VECTOR = 0x0F; // scalar sse, whose vector registers the rules do not follow
+
+        mnemonic_kind classify(const instruction& in);
+    }
+
+    // where a memory operand can point, worked out once per instruction
+    typedef struct memory_operand {
+        bool present;
+        bool frame; // rbp relative with a constant offset, covering [start, start + size)
+        bool stack; // rsp relative, in the outgoing argument area
+        int start;
+        int size;
+    } memory_operand;
+
+    // what an instruction does: register families it reads, may write, and certainly
+    // replaces whole, and the memory it reads and writes
+    typedef struct instruction_effects {
+        mnemonic_kind kind;
+        unsigned int reads;
+        unsigned int writes;
+        unsigned int kills;
+        memory_operand read;
+        memory_operand written;
+    } instruction_effects;
+
+    // a subroutine while the rules rewrite it. effects are kept in step with code, and
+    // frame_escapes is set when the address of the frame can be held outside rbp and rsp
+    typedef struct peephole_code {
+        std::vector<instruction>& code;
+        std::vector<instruction_effects> effects;
+        bool frame_escapes;
+    } peephole_code;
+
+    // a rewrite tried at every instruction of a subroutine
+    typedef bool (*peephole_rewrite)(peephole_code& pc, std::size_t i);
+
+    typedef struct peephole_rule {
+        const char* name;
+        peephole_rewrite rewrite;
+    } peephole_rule;
+
+    class peephole
+    {
+    private:
+        std::vector<std::size_t> fired;
+        std::size_t removed;
+    public:
+        peephole();
+        void run(std::vector<instruction>& code);
+        std::string report();
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <vector>
+
+#include "runtime.h"
+
+namespace arrow
+{
+    namespace runtime
+    {
+        int size_class(std::int64_t size, std::int64_t alignment)
+        {
+            std::int64_t bytes = std::max<std::int64_t>(size, alignment);
+            for (int c = 0; c < SIZE_CLASSES; c++)
+            {
+                if (bytes <= class_size(c))
+                    return c;
+            }
+            return -1;
+        }
+
+        int class_size(int c)
+        {
+            return 8 << c;
+        }
+
+        std::string free_list(int c)
+        {
+            return c == 0 ? "qword [rel __arrow_free_lists]" : "qword [rel __arrow_free_lists + " + std::to_string(c * 8) + ']';
+        }
+
+        void code(assembler& as, std::initializer_list<std::string> lines)
+        {
+            for (const std::string& line : lines)
+                as << '\t' + line;
+        }
+
+        void code(assembler& as, const std::vector<std::string>& lines)
+        {
+            for (const std::string& line : lines)
+                as << '\t' + line;
+        }
+
+        void routine(assembler& as, const std::string& name, std::initializer_list<std::string> lines)
+        {
+            as << name + ':';
+            code(as, lines);
+        }
+
+        void link(assembler& as, operating_system os)
+        {
+            std::string classes = std::to_string(SIZE_CLASSES), chunks = std::to_string(CHUNKS);
+            std::string largest = std::to_string(class_size(SIZE_CLASSES - 1)), alignment = std::to_string(MAX_ALIGNMENT);
+            std::string page = std::to_string(PAGE_SIZE);
+            bool windows = os == operating_systems::WINDOWS;
+            if (windows)
+            {
+                as.external("GetProcessHeap");
+                as.external("HeapAlloc");
+                as.external("HeapFree");
+            }
+            as << arrow::bss;
+            if (windows)
+                as << "__arrow_heap resq 1";
+            as << "__arrow_free_lists resq " + classes;
+            as << "__arrow_bump resq " + classes; // next block of the class's current chunk
+            as << "__arrow_bump_end resq " + classes;
+            as << "__arrow_chunk_next resq 1";
+            as << "__arrow_chunk_class resb " + chunks;
+            as << "alignb " + alignment;
+            as << "__arrow_arena resb " + std::to_string(CHUNKS * CHUNK_SIZE);
+            as << arrow::text;
+            // the general entry, for sizes only known at run time and blocks too
+            // large for a class. large blocks are over allocated so they can be
+            // aligned, with what it takes to free them kept just below them
+            routine(as, ALLOCATE, {
+                "cmp rcx, rdx",
+                "cmovb rcx, rdx",
+                "cmp rcx, " + largest,
+                "ja .large",
+                "xor edx, edx",
+                "mov eax, 8",
+                ".class:",
+                "cmp rax, rcx",
+                "jae .small",
+                "add rax, rax",
+                "inc edx",
+                "jmp .class",
+                ".small:",
+                "lea r8, [rel __arrow_free_lists]",
+                "mov rax, qword [r8 + rdx * 8]",
+                "test rax, rax",
+                "jz .fresh",
+                "mov r9, qword [rax]",
+                "mov qword [r8 + rdx * 8], r9",
+                "mov qword [rax], 0",
+                "ret",
+                ".fresh:",
+                "mov ecx, edx",
+                "jmp " + REFILL,
+                ".large:" });
+            if (windows)
+            {
+                code(as, {
+                    "push rbx",
+                    "sub rsp, 32",
+                    "mov rbx, rcx",
+                    "mov rcx, qword [rel __arrow_heap]",
+                    "test rcx, rcx",
+                    "jnz .heap",
+                    "call GetProcessHeap",
+                    "mov qword [rel __arrow_heap], rax",
+                    "mov rcx, rax",
+                    ".heap:",
+                    "mov edx, 8", // HEAP_ZERO_MEMORY
+                    "lea r8, [rbx + " + alignment + ']',
+                    "call HeapAlloc",
+                    "test rax, rax",
+                    "jz .failed",
+                    "lea rdx, [rax + " + alignment + ']',
+                    "and rdx, -" + alignment,
+                    "mov qword [rdx - 8], rax",
+                    "mov rax, rdx",
+                    ".failed:",
+                    "add rsp, 32",
+                    "pop rbx",
+                    "ret" });
+            }
+            else
+            {
+                // whole pages straight from the kernel, which come zeroed. the mapping's
+                // start and length are what munmap needs back
+                code(as, {
+                    "lea rsi, [rcx + " + std::to_string(MAX_ALIGNMENT + PAGE_SIZE - 1) + ']',
+                    "and rsi, -" + page,
+                    "mov eax, 9", // mmap
+                    "xor edi, edi",
+                    "mov edx, 3", // PROT_READ | PROT_WRITE
+                    "mov r10d, 0x22", // MAP_PRIVATE | MAP_ANONYMOUS
+                    "mov r8, -1",
+                    "xor r9d, r9d",
+                    "syscall",
+                    "cmp rax, -" + page,
+                    "ja .failed",
+                    "lea rdx, [rax + " + alignment + ']',
+                    "mov qword [rdx - 8], rax",
+                    "mov qword [rdx - 16], rsi",
+                    "mov rax, rdx",
+                    "ret",
+                    ".failed:",
+                    "xor eax, eax",
+                    "ret" });
+            }
+            // carves the next block of a class, starting a new arena chunk for it when
+            // the current one is full. arena memory is zero until it is first handed out
+            routine(as, REFILL, {
+                "mov edx, ecx",
+                "mov r8d, 8",
+                "shl r8, cl",
+                "lea r9, [rel __arrow_bump]",
+                "mov rax, qword [r9 + rdx * 8]",
+                "lea r10, [rax + r8]",
+                "test rax, rax",
+                "jz .chunk",
+                "lea r11, [rel __arrow_bump_end]",
+                "cmp r10, qword [r11 + rdx * 8]",
+                "ja .chunk",
+                "mov qword [r9 + rdx * 8], r10",
+                "ret",
+                ".chunk:",
+                "mov rax, qword [rel __arrow_chunk_next]",
+                "cmp rax, " + chunks,
+                "jae .full",
+                "inc qword [rel __arrow_chunk_next]",
+                "lea r10, [rel __arrow_chunk_class]",
+                "mov byte [r10 + rax], dl",
+                "shl rax, " + std::to_string(CHUNK_SHIFT),
+                "lea r10, [rel __arrow_arena]",
+                "add rax, r10",
+                "lea r10, [rax + " + std::to_string(CHUNK_SIZE) + ']',
+                "lea r11, [rel __arrow_bump_end]",
+                "mov qword [r11 + rdx * 8], r10",
+                "lea r10, [rax + r8]",
+                "mov qword [r9 + rdx * 8], r10",
+                "ret",
+                ".full:",
+                "mov rcx, r8",
+                "jmp " + ALLOCATE + ".large" });
+            // gives a block back. arena blocks are cleared and pushed onto the free list
+            // of their chunk's class, large blocks go back to the system
+            routine(as, RELEASE, {
+                "mov rax, rcx",
+                "lea r8, [rel __arrow_arena]",
+                "sub rax, r8",
+                "cmp rax, " + std::to_string(CHUNKS * CHUNK_SIZE),
+                "jae .large",
+                "shr rax, " + std::to_string(CHUNK_SHIFT),
+                "lea r8, [rel __arrow_chunk_class]",
+                "movzx r9d, byte [r8 + rax]",
+                "mov rdx, rdi",
+                "mov rdi, rcx",
+                "mov r8, rcx",
+                "mov ecx, r9d",
+                "mov eax, 1",
+                "shl eax, cl",
+                "mov ecx, eax",
+                "xor eax, eax",
+                "rep stosq",
+                "mov rdi, rdx",
+                "lea rax, [rel __arrow_free_lists]",
+                "mov rdx, qword [rax + r9 * 8]",
+                "mov qword [r8], rdx",
+                "mov qword [rax + r9 * 8], r8",
+                "ret",
+                ".large:",
+                "test rcx, rcx",
+                "jz .none" });
+            if (windows)
+            {
+                code(as, {
+                    "mov r8, qword [rcx - 8]",
+                    "mov rcx, qword [rel __arrow_heap]",
+                    "xor edx, edx",
+                    "jmp HeapFree" });
+            }
+            else
+            {
+                code(as, {
+                    "mov rdi, qword [rcx - 8]",
+                    "mov rsi, qword [rcx - 16]",
+                    "mov eax, 11", // munmap
+                    "syscall" });
+            }
+            code(as, { ".none:", "ret" });
+            as << arrow::data;
+        }
+        std::string kernel(bulk_op op, value_type type)
+        {
+            return "__arrow_" + bulk_ops::name(op) + '_' + value_types::name(type);
+        }
+
+        // the packed instruction doing op on elements of type at a level, empty when
+        // there is none: bytes and qwords always multiply one at a time, and dwords
+        // only multiply as vectors from avx2
+        std::string packed(bulk_op op, value_type type, int level)
+        {
+            if (op == bulk_ops::ADD)
+            {
+                switch (type)
+                {
+                    case value_types::I8: return "paddb";
+                    case value_types::I16: return "paddw";
+                    case value_types::I32: return "paddd";
+                    case value_types::F32: return "addps";
+                    case value_types::F64: return "addpd";
+                    default: return "paddq";
+                }
+            }
+            switch (type)
+            {
+                case value_types::I16: return "pmullw";
+                case value_types::I32: return level == 0 ? "" : "pmulld";
+                case value_types::F32: return "mulps";
+                case value_types::F64: return "mulpd";
+                default: return "";
+            }
+        }
+
+        // what one element takes when it does not fill a vector. fills and copies
+        // go a byte at a time, the fill pattern turning under it
+        std::vector<std::string> element(bulk_op op, value_type type)
+        {
+            if (op == bulk_ops::FILL)
+                return { "mov byte [rcx + rax], dl", "ror rdx, 8" };
+            if (op == bulk_ops::COPY)
+                return { "mov r9b, byte [rdx + rax]", "mov byte [rcx + rax], r9b" };
+            int size = value_types::size(type);
+            std::string width = size == 1 ? "byte" : size == 2 ? "word" : size == 4 ? "dword" : "qword";
+            std::string to = width + " [rcx + rax]", from = width + " [rdx + rax]";
+            std::string r9 = resolve_register("r9", size);
+            if (value_types::floating(type))
+            {
+                std::string suffix = type == value_types::F32 ? "ss" : "sd";
+                return { "mov" + suffix + " xmm0, " + to, (op == bulk_ops::ADD ? "add" : "mul") + suffix + " xmm0, " + from, "mov" + suffix + ' ' + to + ", xmm0" };
+            }
+            if (op == bulk_ops::ADD)
+                return { "mov " + r9 + ", " + from, "add " + to + ", " + r9 };
+            if (size < 4)
+                return { "movzx r9d, " + to, "movzx r10d, " + from, "imul r9d, r10d", "mov " + to + ", " + r9 };
+            return { "mov " + r9 + ", " + to, "imul " + r9 + ", " + from, "mov " + to + ", " + r9 };
+        }
+
+        // the vector loop of a level, with what has to happen before it. empty when the
+        // level cannot do op on type
+        std::pair<std::vector<std::string>, std::vector<std::string>> vectors(bulk_op op, value_type type, int level)
+        {
+            std::string v = level == 0 ? "xmm" : level == 1 ? "ymm" : "zmm";
+            std::string move = level == 0 ? "movdqu " : level == 1 ? "vmovdqu " : "vmovdqu64 ";
+            if (op == bulk_ops::FILL)
+            {
+                std::string broadcast = level == 0 ? "punpcklqdq xmm0, xmm0" : "vpbroadcastq " + v + "0, xmm0";
+                return { { "movq xmm0, rdx", broadcast }, { move + "[rcx + rax], " + v + '0' } };
+            }
+            if (op == bulk_ops::COPY)
+                return { {}, { move + v + "0, [rdx + rax]", move + "[rcx + rax], " + v + '0' } };
+            std::string instruction = packed(op, type, level);
+            if (instruction.empty())
+                return {};
+            if (level == 0)
+                return { {}, { "movdqu xmm0, [rcx + rax]", "movdqu xmm1, [rdx + rax]", instruction + " xmm0, xmm1", "movdqu [rcx + rax], xmm0" } };
+            return { {}, { move + v + "0, [rcx + rax]", 'v' + instruction + ' ' + v + "0, " + v + "0, [rdx + rax]", move + "[rcx + rax], " + v + '0' } };
+        }
+
+        // the body of a kernel, over the r8 bytes at rcx. counts that are not positive
+        // do nothing
+        std::vector<std::string> bulk_loop(bulk_op op, value_type type)
+        {
+            static const char* LEVELS[] = { ".sse2", ".avx2", ".avx512" };
+            std::vector<std::string> lines = { "xor eax, eax", "movzx r9d, byte [rel " + LEVEL + ']' };
+            std::pair<std::vector<std::string>, std::vector<std::string>> loops[3];
+            for (int level = 0; level < 3; level++)
+                loops[level] = vectors(op, type, level);
+            for (int level = 2; level > 0; level--)
+            {
+                if (loops[level].second.empty())
+                    continue;
+                lines.push_back("cmp r9d, " + std::to_string(level));
+                lines.push_back("jae " + std::string(LEVELS[level]));
+            }
+            if (loops[0].second.empty())
+                lines.push_back("jmp .tail");
+            for (int level = 0; level < 3; level++)
+            {
+                if (loops[level].second.empty())
+                    continue;
+                std::string label = LEVELS[level];
+                lines.push_back(label + ':');
+                lines.insert(lines.end(), loops[level].first.begin(), loops[level].first.end());
+                lines.push_back(label + "_loop:");
+                lines.push_back("lea r9, [rax + " + std::to_string(16 << level) + ']');
+                lines.push_back("cmp r9, r8");
+                lines.push_back("jg " + label + "_done");
+                lines.insert(lines.end(), loops[level].second.begin(), loops[level].second.end());
+                lines.push_back("mov rax, r9");
+                lines.push_back("jmp " + label + "_loop");
+                lines.push_back(label + "_done:");
+                if (level != 0)
+                    lines.push_back("vzeroupper"); // no penalty for the sse that follows
+                lines.push_back("jmp .tail");
+            }
+            std::vector<std::string> step = element(op, type);
+            lines.push_back(".tail:");
+            lines.push_back("cmp rax, r8");
+            lines.push_back("jge .done");
+            lines.insert(lines.end(), step.begin(), step.end());
+            int size = op == bulk_ops::FILL || op == bulk_ops::COPY ? 1 : value_types::size(type);
+            lines.push_back("add rax, " + std::to_string(size));
+            lines.push_back("jmp .tail");
+            lines.push_back(".done:");
+            lines.push_back("ret");
+            return lines;
+        }
+
+        void link_kernels(assembler& as, const std::set<std::pair<bulk_op, value_type>>& kernels)
+        {
+            as << arrow::bss;
+            as << LEVEL + " resb 1";
+            as << arrow::text;
+            // cpuid says what the processor has and xgetbv whether the system saves
+            // the wider registers
+            routine(as, DETECT, {
+                "push rax",
+                "push rbx",
+                "push rcx",
+                "push rdx",
+                "push r8",
+                "push r9",
+                "xor r8d, r8d",
+                "mov eax, 1",
+                "cpuid",
+                "and ecx, 0x18000000", // osxsave and avx
+                "cmp ecx, 0x18000000",
+                "jne .done",
+                "xor ecx, ecx",
+                "xgetbv",
+                "mov r9d, eax",
+                "and eax, 6", // xmm and ymm state
+                "cmp eax, 6",
+                "jne .done",
+                "mov eax, 7",
+                "xor ecx, ecx",
+                "cpuid",
+                "test ebx, 0x20", // avx2
+                "jz .done",
+                "mov r8d, 1",
+                "and r9d, 0xE0", // opmask and zmm state
+                "cmp r9d, 0xE0",
+                "jne .done",
+                "and ebx, 0x40010000", // avx-512 f and bw
+                "cmp ebx, 0x40010000",
+                "jne .done",
+                "mov r8d, 2",
+                ".done:",
+                "mov byte [rel " + LEVEL + "], r8b",
+                "pop r9",
+                "pop r8",
+                "pop rdx",
+                "pop rcx",
+                "pop rbx",
+                "pop rax",
+                "ret" });
+            // fills and copies of every type share one loop over bytes, fills with the
+            // value repeated across a qword
+            bool fills = false, copies = false;
+            for (auto& [op, type] : kernels)
+            {
+                int size = value_types::size(type);
+                std::string shift = size == 1 ? "" : "shl r8, " + std::to_string(size == 2 ? 1 : size == 4 ? 2 : 3);
+                as << kernel(op, type) + ':';
+                if (op == bulk_ops::FILL)
+                {
+                    if (size == 1)
+                        code(as, { "movzx edx, dl", "mov r9, 0x0101010101010101", "imul rdx, r9" });
+                    else if (size == 2)
+                        code(as, { "movzx edx, dx", "mov r9, 0x0001000100010001", "imul rdx, r9" });
+                    else if (size == 4)
+                        code(as, { "mov edx, edx", "mov r9, 0x0000000100000001", "imul rdx, r9" });
+                    fills = true;
+                }
+                copies = copies || op == bulk_ops::COPY;
+                if (!shift.empty())
+                    code(as, { shift });
+                if (op == bulk_ops::FILL || op == bulk_ops::COPY)
+                    code(as, { "jmp __arrow_" + bulk_ops::name(op) });
+                else
+                    code(as, bulk_loop(op, type));
+            }
+            if (fills)
+            {
+                as << "__arrow_" + bulk_ops::name(bulk_ops::FILL) + ':';
+                code(as, bulk_loop(bulk_ops::FILL, value_types::I8));
+            }
+            if (copies)
+            {
+                as << "__arrow_" + bulk_ops::name(bulk_ops::COPY) + ':';
+                code(as, bulk_loop(bulk_ops::COPY, value_types::I8));
+            }
+            as << arrow::data;
+        }
+    }
+}
\ No newline at end of file
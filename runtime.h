@@ -0,0 +1,55 @@
+#ifndef ARROW_RUNTIME_H
+#define ARROW_RUNTIME_H
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "assembler.h"
+#include "lower.h"
+
+namespace arrow
+{
+    // the allocator linked into programs that use ref and del. small blocks come in
+    // power of two size classes carved from a bump arena in .bss and are recycled
+    // through one free list per class. anything larger, or anything once the arena
+    // is used up, comes from the process heap on windows and from mmap on linux.
+    // its routines take their arguments in rcx and rdx on every target
+    namespace runtime
+    {
+        const int SIZE_CLASSES = 6; // 8 to 256 bytes
+        const int MAX_ALIGNMENT = 64;
+        const int CHUNK_SHIFT = 16;
+        const int CHUNK_SIZE = 1 << CHUNK_SHIFT; // arena chunks each serve a single class
+        const int CHUNKS = 64;
+        const int PAGE_SIZE = 4096;
+
+        const std::string ALLOCATE = "__arrow_allocate"; // rcx size, rdx alignment, block in rax
+        const std::string REFILL = "__arrow_refill"; // ecx class with an empty free list, fresh block in rax
+        const std::string RELEASE = "__arrow_release"; // rcx block
+
+        // the class of a block of size bytes aligned to alignment, -1 when it is too
+        // large for one
+        int size_class(std::int64_t size, std::int64_t alignment);
+        int class_size(int c);
+        std::string free_list(int c);
+
+        // writes the allocator's state and routines into the output once
+        void link(assembler& as, operating_system os);
+
+        // the kernels of vadd, vmul, vfill and vcopy take the destination in rcx, the
+        // source or value in rdx and the element count in r8 on every target, and only
+        // touch volatile registers. each runs through sse2, avx2 or avx-512 vectors,
+        // whichever is the widest the level DETECT found at start allows, then finishes
+        // the elements that did not fill a vector one at a time
+        const std::string DETECT = "__arrow_detect"; // keeps every register
+        const std::string LEVEL = "__arrow_simd"; // byte: 0 sse2, 1 avx2, 2 avx-512 f and bw
+        const std::vector<std::string> KERNEL_REGISTERS = { "rcx", "rdx", "r8" };
+
+        std::string kernel(bulk_op op, value_type type);
+        void link_kernels(assembler& as, const std::set<std::pair<bulk_op, value_type>>& kernels);
+    }
+}
+
+#endif
\ No newline at end of file
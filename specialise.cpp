@@ -0,0 +1,217 @@
+#include <map>
+
+#include "fold.h"
+#include "specialise.h"
+
+namespace arrow
+{
+    // a call whose pulled arguments are all constants, where it and the arguments
+    // passed to it are
+    typedef struct constant_call {
+        std::size_t block;
+        std::size_t node;
+        int callee;
+        std::vector<std::pair<std::size_t, std::size_t>> arguments;
+        std::vector<std::int64_t> constants;
+    } constant_call;
+
+    // what calls passing some constants become: a copy of the callee, the constant
+    // it returns when clone is -1, or nothing when clone is -2 and the label already
+    // has as many copies as it may
+    typedef struct specialisation {
+        int clone;
+        std::int64_t constant;
+    } specialisation;
+
+    bool has_asm(const ir_function& fn)
+    {
+        for (const ir_block& block : fn.blocks)
+        {
+            for (const ir_node& n : block.nodes)
+            {
+                if (n.op == ir_ops::ASM)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // whether all that is left of fn is returning a constant, and which
+    bool returns_constant(ir_function& fn, std::int64_t& constant)
+    {
+        std::map<std::uint32_t, std::int64_t> constants;
+        bool returned = false;
+        for (ir_block& block : fn.blocks)
+        {
+            for (ir_node& n : block.nodes)
+            {
+                if (n.op == ir_ops::CONST)
+                    constants[n.dst] = n.imm;
+                else if (n.op == ir_ops::RET && constants.count(n.a) != 0)
+                {
+                    constant = constants[n.a];
+                    returned = true;
+                }
+                else
+                    return false;
+            }
+        }
+        return returned;
+    }
+
+    // what specialisation keeps track of across labels: the copies made for each
+    // callee and constants, how many of each label were added, the last number
+    // given to one of their names, and which labels have inline asm
+    typedef struct specialiser {
+        std::map<std::pair<int, std::vector<std::int64_t>>, specialisation> made;
+        std::vector<int> copies;
+        std::vector<int> numbers;
+        std::vector<bool> assembly;
+    } specialiser;
+
+    // specialises every call label c makes that passes constants, found in one walk
+    // over it. the label is folded once afterwards, for what those calls returned
+    void specialise_calls(ir_module& module, std::size_t c, specialiser& state, std::vector<std::string>& report)
+    {
+        std::vector<constant_call> calls;
+        {
+            ir_function& fn = module.functions[c];
+            std::vector<bool> known(fn.values.size(), false);
+            std::vector<std::int64_t> constants(fn.values.size(), 0);
+            // arguments wait for the next call, which may be in a later block
+            std::map<std::int64_t, std::pair<std::size_t, std::size_t>> pending;
+            for (std::size_t b = 0; b < fn.blocks.size(); b++)
+            {
+                for (std::size_t i = 0; i < fn.blocks[b].nodes.size(); i++)
+                {
+                    ir_node& n = fn.blocks[b].nodes[i];
+                    if (n.op == ir_ops::CONST)
+                    {
+                        known[n.dst] = true;
+                        constants[n.dst] = n.imm;
+                    }
+                    if (n.op == ir_ops::ARG)
+                        pending[n.imm] = { b, i };
+                    if (n.op == ir_ops::BULK)
+                        pending.clear();
+                    if (n.op != ir_ops::CALL)
+                        continue;
+                    int callee = module.find_function(module.names[n.imm]);
+                    bool complete = pending.size() == n.a && (n.a == 0 || pending.rbegin()->first == n.a - 1);
+                    if (callee != -1 && complete && module.functions[callee].params > 0 && module.functions[callee].params <= (int) n.a && !state.assembly[callee])
+                    {
+                        constant_call call = { b, i, callee, {}, {} };
+                        for (auto& [index, where] : pending)
+                        {
+                            std::uint32_t v = fn.blocks[where.first].nodes[where.second].a;
+                            if (index < (std::int64_t) module.functions[callee].params)
+                            {
+                                if (!known[v])
+                                    break;
+                                call.constants.push_back(constants[v]);
+                            }
+                            call.arguments.push_back(where);
+                        }
+                        if (call.arguments.size() == n.a)
+                            calls.push_back(call);
+                    }
+                    pending.clear();
+                }
+            }
+        }
+        if (calls.empty())
+            return;
+        bool changed = false;
+        std::vector<std::vector<bool>> dropped;
+        for (ir_block& block : module.functions[c].blocks)
+            dropped.emplace_back(block.nodes.size(), false);
+        for (constant_call& call : calls)
+        {
+            auto key = std::make_pair(call.callee, call.constants);
+            auto it = state.made.find(key);
+            if (it == state.made.end())
+            {
+                ir_function copy = module.functions[call.callee];
+                copy.params = 0;
+                for (ir_block& block : copy.blocks)
+                {
+                    for (ir_node& n : block.nodes)
+                    {
+                        if (n.op == ir_ops::PARAM)
+                        {
+                            n.op = ir_ops::CONST;
+                            n.imm = call.constants[n.imm];
+                        }
+                    }
+                }
+                std::vector<std::string> folded;
+                fold_label(copy, folded);
+                specialisation result = { -2, 0 };
+                if (returns_constant(copy, result.constant))
+                    result.clone = -1;
+                else if (state.copies[call.callee] < SPECIALISATION_LIMIT)
+                {
+                    state.copies[call.callee]++;
+                    // numbers only pass over names the program already has
+                    do
+                        copy.name = module.functions[call.callee].name + ".s" + std::to_string(++state.numbers[call.callee]);
+                    while (module.find_function(copy.name) != -1 || module.externs.count(copy.name) != 0);
+                    result.clone = module.function(std::move(copy));
+                    state.copies.push_back(0);
+                    state.numbers.push_back(0);
+                    state.assembly.push_back(false);
+                }
+                it = state.made.emplace(key, result).first;
+            }
+            if (it->second.clone == -2)
+                continue;
+            changed = true;
+            ir_function& fn = module.functions[c];
+            ir_node& n = fn.blocks[call.block].nodes[call.node];
+            std::string where = " on line " + std::to_string(n.line) + " of " + fn.name;
+            for (auto& [b, i] : call.arguments)
+                dropped[b][i] = true;
+            if (it->second.clone == -1)
+            {
+                report.push_back("call to " + module.names[n.imm] + where + " folded to " + std::to_string(it->second.constant));
+                n = { ir_ops::CONST, n.type, n.dst, NO_VALUE, NO_VALUE, it->second.constant, n.line };
+                continue;
+            }
+            std::string& name = module.functions[it->second.clone].name;
+            report.push_back("call to " + module.names[n.imm] + where + " specialised as " + name);
+            n.imm = module.name(name);
+            n.a = 0;
+        }
+        if (!changed)
+            return;
+        ir_function& fn = module.functions[c];
+        for (std::size_t b = 0; b < fn.blocks.size(); b++)
+        {
+            std::vector<ir_node> nodes;
+            for (std::size_t i = 0; i < fn.blocks[b].nodes.size(); i++)
+            {
+                if (!dropped[b][i])
+                    nodes.push_back(fn.blocks[b].nodes[i]);
+            }
+            fn.blocks[b].nodes = nodes;
+        }
+        // what the calls returned may fold further in the caller
+        std::vector<std::string> folded;
+        fold_label(fn, folded);
+    }
+
+    std::vector<std::string> specialise_labels(ir_module& module)
+    {
+        std::vector<std::string> report;
+        specialiser state;
+        state.copies.assign(module.functions.size(), 0);
+        state.numbers.assign(module.functions.size(), 0);
+        for (const ir_function& fn : module.functions)
+            state.assembly.push_back(has_asm(fn));
+        // copies are looked through as well, as folding may have left calls in them
+        // passing constants
+        for (std::size_t c = 0; c < module.functions.size(); c++)
+            specialise_calls(module, c, state, report);
+        return report;
+    }
+}
\ No newline at end of file
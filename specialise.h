@@ -0,0 +1,23 @@
+#ifndef ARROW_SPECIALISE_H
+#define ARROW_SPECIALISE_H
+
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+namespace arrow
+{
+    // the most copies of any one label that specialisation adds to the program
+    const int SPECIALISATION_LIMIT = 4;
+
+    // gives calls that pass only constants a copy of the label called with its pulls
+    // replaced by those constants, folded. calls passing the same constants share a
+    // copy. when a copy folds down to returning a constant, the call is replaced by
+    // that constant and the copy is dropped. labels with inline asm are left alone,
+    // as it may read the arguments where they were passed. returns a line describing
+    // each call that was specialised
+    std::vector<std::string> specialise_labels(ir_module& module);
+}
+
+#endif
\ No newline at end of file
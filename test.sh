@@ -0,0 +1,94 @@
+#!/bin/sh
+# builds the compiler, then runs every test program natively, under --jit and
+# through --interpret. a program fails when the three print or return different
+# things, or when it has a .out file next to it saying something else. it is
+# also built with each optimisation turned off, which must not change anything.
+# the first line of a .report file is options to compile with, and the rest what
+# the compiler has to print with them. programs in test/errors fail unless the
+# compiler rejects them as their .out file says
+g++ -o arrow *.cpp || exit 1
+root=$(pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+echo arrow > "$work/a.txt" # what input.ar reads
+switches="--no-peephole --no-regalloc --no-escape --no-inline --no-fold --no-specialise --no-prune --no-merge"
+failed=0
+# the bulk kernels take the widest vectors the processor has, so programs using
+# them also run at every narrower level, forced right after main detects it
+levels=0
+grep -qw avx2 /proc/cpuinfo && levels="$levels 1"
+grep -qw avx512f /proc/cpuinfo && grep -qw avx512bw /proc/cpuinfo && levels="$levels 2"
+
+# what a command prints, then a line with the status it exits with
+run()
+{
+    (cd "$work" && "$@"; printf '\nexit %d\n' $?) 2>&1
+}
+
+# fails program $1 when what $2 gave is not what $3 holds
+expect()
+{
+    if ! cmp -s "$3" "$work/$2"; then
+        echo "$1: $2 gave"
+        diff "$3" "$work/$2"
+        failed=1
+    fi
+}
+
+# compiles and links program $1 natively with the options after it
+build()
+{
+    source=$1
+    shift
+    if ./arrow --target=linux "$@" "$source" > "$work/log" && gcc -o "$work/program" "$source.o"; then
+        rm -f "$source.o"
+        return 0
+    fi
+    echo "$source: does not build $*"
+    cat "$work/log"
+    failed=1
+    return 1
+}
+
+for f in test/*.ar; do
+    build "$f" || continue
+    run ./program > "$work/native"
+    run "$root/arrow" --jit "$root/$f" > "$work/jit"
+    run "$root/arrow" --interpret "$root/$f" > "$work/interpret"
+    expect "$f" jit "$work/native"
+    expect "$f" interpret "$work/native"
+    if [ -f "${f%.ar}.out" ]; then
+        expect "$f" native "${f%.ar}.out"
+    fi
+    if [ -f "${f%.ar}.report" ]; then
+        ./arrow --target=linux $(head -n 1 "${f%.ar}.report") "$f" > "$work/report"
+        rm -f "$f.o"
+        tail -n +2 "${f%.ar}.report" > "$work/expected"
+        expect "$f" report "$work/expected"
+    fi
+    for switch in $switches; do
+        build "$f" $switch || continue
+        run ./program > "$work/native$switch"
+        expect "$f" "native$switch" "$work/native"
+    done
+    grep -qE '^ *(vadd|vmul|vfill|vcopy) ' "$f" || continue
+    for level in $levels; do
+        forced="$work/$(basename "$f" .ar).$level.ar"
+        sed "s/^main {/main {\n    asm \"mov byte [rel __arrow_simd], $level\"/" "$f" > "$forced"
+        build "$forced" || continue
+        run ./program > "$work/level-$level"
+        run "$root/arrow" --jit "$forced" > "$work/jit-level-$level"
+        expect "$f" level-$level "$work/native"
+        expect "$f" jit-level-$level "$work/native"
+    done
+done
+for f in test/errors/*.ar; do
+    [ -f "$f" ] || continue
+    run "$root/arrow" --target=linux "$root/$f" > "$work/compiler"
+    rm -f "$f.o"
+    expect "$f" compiler "${f%.ar}.out"
+done
+if [ $failed -eq 0 ]; then
+    echo "all tests passed"
+fi
+exit $failed
\ No newline at end of file
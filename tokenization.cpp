@@ -1,30 +1,126 @@
+#include <array>
+
 #include "tokenization.h"
 
 namespace arrow
 {
-    const std::vector<std::string> PUNCTUATORS = {
-        ",",
-        "*",
-        "{",
-        "}",
-        ";"
+    struct keyword
+    {
+        std::string_view word;
+        token_type type;
+        opcode op;
     };
 
-    const std::vector<std::string> MNEMONICS = {
-        "ref",
-        "copy",
-        "set",
-        "pass",
-        "pull",
-        "push",
-        "pop",
-        "call",
-        "add",
-        "del",
-        "def",
-        "ret"
+    constexpr keyword KEYWORDS[] = {
+        { "ref", token_types::MNEMONIC, opcodes::REF },
+        { "copy", token_types::MNEMONIC, opcodes::COPY },
+        { "set", token_types::MNEMONIC, opcodes::SET },
+        { "pass", token_types::MNEMONIC, opcodes::PASS },
+        { "pull", token_types::MNEMONIC, opcodes::PULL },
+        { "push", token_types::MNEMONIC, opcodes::PUSH },
+        { "pop", token_types::MNEMONIC, opcodes::POP },
+        { "call", token_types::MNEMONIC, opcodes::CALL },
+        { "add", token_types::MNEMONIC, opcodes::ADD },
+        { "del", token_types::MNEMONIC, opcodes::DEL },
+        { "def", token_types::MNEMONIC, opcodes::DEF },
+        { "ret", token_types::MNEMONIC, opcodes::RET },
+        { "store", token_types::MNEMONIC, opcodes::STORE },
+        { "asm", token_types::MNEMONIC, opcodes::ASM },
+        { "vadd", token_types::MNEMONIC, opcodes::VADD },
+        { "vmul", token_types::MNEMONIC, opcodes::VMUL },
+        { "vfill", token_types::MNEMONIC, opcodes::VFILL },
+        { "vcopy", token_types::MNEMONIC, opcodes::VCOPY },
+
+        { "byte", token_types::TYPE_SPECIFIER, opcodes::BYTE },
+        { "short", token_types::TYPE_SPECIFIER, opcodes::SHORT },
+        { "int", token_types::TYPE_SPECIFIER, opcodes::INT },
+        { "long", token_types::TYPE_SPECIFIER, opcodes::LONG },
+        { "float", token_types::TYPE_SPECIFIER, opcodes::FLOAT },
+        { "double", token_types::TYPE_SPECIFIER, opcodes::DOUBLE },
+
+        { ",", token_types::PUNCTUATOR, opcodes::COMMA },
+        { "*", token_types::PUNCTUATOR, opcodes::ASTERISK },
+        { "{", token_types::PUNCTUATOR, opcodes::LEFT_BRACE },
+        { "}", token_types::PUNCTUATOR, opcodes::RIGHT_BRACE },
+        { ";", token_types::PUNCTUATOR, opcodes::SEMICOLON }
     };
 
+    // keywords are looked up through a perfect hash: the seed below is searched for at
+    // compile time so that every keyword lands in its own slot, which leaves one hash
+    // and one compare per lexeme
+    const std::size_t KEYWORD_TABLE_SIZE = 64;
+    const std::size_t MAX_KEYWORD_LENGTH = 6;
+
+    constexpr std::uint32_t keyword_hash(std::string_view t, std::uint32_t seed)
+    {
+        std::uint32_t h = 2166136261u ^ seed;
+        for (char c : t)
+        {
+            h ^= (unsigned char) c;
+            h *= 16777619u;
+        }
+        return (h ^ (h >> 16)) % KEYWORD_TABLE_SIZE;
+    }
+
+    constexpr std::uint32_t find_keyword_seed()
+    {
+        for (std::uint32_t seed = 0; seed < 1000000; seed++)
+        {
+            std::uint64_t used = 0;
+            bool collided = false;
+            for (const keyword& k : KEYWORDS)
+            {
+                std::uint64_t slot = 1ULL << keyword_hash(k.word, seed);
+                if (used & slot)
+                {
+                    collided = true;
+                    break;
+                }
+                used |= slot;
+            }
+            if (!collided)
+                return seed;
+        }
+        return UINT32_MAX;
+    }
+
+    constexpr std::uint32_t KEYWORD_SEED = find_keyword_seed();
+    static_assert(KEYWORD_SEED != UINT32_MAX, "no perfect hash seed exists for the keyword table");
+
+    constexpr std::array<keyword, KEYWORD_TABLE_SIZE> build_keyword_table()
+    {
+        std::array<keyword, KEYWORD_TABLE_SIZE> table = {};
+        for (const keyword& k : KEYWORDS)
+        {
+            if (k.word.length() > MAX_KEYWORD_LENGTH)
+                return {};
+            table[keyword_hash(k.word, KEYWORD_SEED)] = k;
+        }
+        return table;
+    }
+
+    constexpr std::array<opcode, 256> build_punctuator_table()
+    {
+        std::array<opcode, 256> table = {};
+        for (const keyword& k : KEYWORDS)
+        {
+            if (k.type == token_types::PUNCTUATOR)
+                table[(unsigned char) k.word[0]] = k.op;
+        }
+        return table;
+    }
+
+    constexpr std::array<keyword, KEYWORD_TABLE_SIZE> KEYWORD_TABLE = build_keyword_table();
+    constexpr std::array<opcode, 256> PUNCTUATOR_TABLE = build_punctuator_table();
+
+    const keyword* find_keyword(std::string_view t)
+    {
+        if (t.length() == 0 || t.length() > MAX_KEYWORD_LENGTH)
+            return nullptr;
+        const keyword& k = KEYWORD_TABLE[keyword_hash(t, KEYWORD_SEED)];
+        return k.word == t ? &k : nullptr;
+    }
+
     namespace token_types
     {
         std::string name(token_type tt)
@@ -43,59 +139,72 @@ namespace arrow
         }
     }
 
-    bool is_string_literal(std::string& t)
+    namespace opcodes
+    {
+        std::string name(opcode op)
+        {
+            if (op == NONE)
+                return "NONE";
+            for (const keyword& k : KEYWORDS)
+            {
+                if (k.op == op)
+                    return std::string(k.word);
+            }
+            return "UNKNOWN_OPCODE_" + std::to_string(op);
+        }
+    }
+
+    bool is_string_literal(std::string_view t)
     {
         return t.length() >= 2 && t[0] == '\"' && t[t.length() - 1] == '\"';
     }
 
-    bool is_type_specifier(std::string& t)
+    bool is_type_specifier(std::string_view t)
     {
-        return t == "byte" || t == "short" || t == "int" || t == "long" || t == "float" || t == "double";
+        const keyword* k = find_keyword(t);
+        return k != nullptr && k->type == token_types::TYPE_SPECIFIER;
     }
 
-    bool is_mnemonic(std::string& t)
+    bool is_mnemonic(std::string_view t)
     {
-        return std::find(MNEMONICS.begin(), MNEMONICS.end(), t) != MNEMONICS.end(); 
+        const keyword* k = find_keyword(t);
+        return k != nullptr && k->type == token_types::MNEMONIC;
     }
 
-    bool is_numeric_literal(std::string& t)
+    bool is_numeric_literal(std::string_view t)
     {
         if (t.length() == 0)
             return false;
-        for (int i = 0; i < t.length(); i++)
+        for (char c : t)
         {
-            char c = t[i];
             if ((c < '0' || c > '9') && c != '.')
                 return false;
         }
         return true;
     }
 
-    int ends_with_punctuator(std::string& t)
+    bool is_punctuator(char c)
     {
-        for (const auto& punctuator : PUNCTUATORS)
-        {
-            if (punctuator.length() > t.length())
-                continue;
-            bool a = true;
-            for (int i = punctuator.length() - 1, j = t.length() - 1; i >= 0 && j >= 0; i--, j--)
-            {
-                if (punctuator[i] != t[j])
-                {
-                    a = false;
-                    break;
-                }
-            }
-            if (a) return punctuator.length();
-        }
-        return 0;
+        return PUNCTUATOR_TABLE[(unsigned char) c] != opcodes::NONE;
+    }
+
+    opcode punctuator(char c)
+    {
+        return PUNCTUATOR_TABLE[(unsigned char) c];
     }
 
-    void free_tokens(token* t)
+    token_type classify(std::string_view t, opcode& op)
     {
-        if (t == nullptr)
-            return;
-        free_tokens(t->next);
-        delete t;
+        op = opcodes::NONE;
+        if (is_string_literal(t))
+            return token_types::STRING_LITERAL;
+        if (const keyword* k = find_keyword(t))
+        {
+            op = k->op;
+            return k->type;
+        }
+        if (is_numeric_literal(t))
+            return token_types::NUMERIC_LITERAL;
+        return token_types::IDENTIFIER;
     }
 }
\ No newline at end of file
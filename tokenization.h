@@ -2,6 +2,8 @@
 #define ARROW_TOKENIZATION_H
 
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <vector>
 #include <algorithm>
 
@@ -21,19 +23,64 @@ namespace arrow
         std::string name(token_type tt);
     }
 
+    // keywords the lexer recognizes, stored in each token so nothing past the lexer
+    // has to compare strings to find out which one it is looking at
+    typedef unsigned int opcode;
+    namespace opcodes
+    {
+        const opcode NONE = 0x00;
+
+        const opcode REF = 0x01;
+        const opcode COPY = 0x02;
+        const opcode SET = 0x03;
+        const opcode PASS = 0x04;
+        const opcode PULL = 0x05;
+        const opcode PUSH = 0x06;
+        const opcode POP = 0x07;
+        const opcode CALL = 0x08;
+        const opcode ADD = 0x09;
+        const opcode DEL = 0x0A;
+        const opcode DEF = 0x0B;
+        const opcode RET = 0x0C;
+        const opcode STORE = 0x0D;
+        const opcode ASM = 0x0E;
+        const opcode VADD = 0x0F;
+        const opcode VMUL = 0x10;
+        const opcode VFILL = 0x11;
+        const opcode VCOPY = 0x12;
+
+        const opcode BYTE = 0x20;
+        const opcode SHORT = 0x21;
+        const opcode INT = 0x22;
+        const opcode LONG = 0x23;
+        const opcode FLOAT = 0x24;
+        const opcode DOUBLE = 0x25;
+
+        const opcode COMMA = 0x30;
+        const opcode ASTERISK = 0x31;
+        const opcode LEFT_BRACE = 0x32;
+        const opcode RIGHT_BRACE = 0x33;
+        const opcode SEMICOLON = 0x34;
+
+        const opcode COUNT = 0x35;
+
+        std::string name(opcode op);
+    }
+
     typedef struct token {
-        std::string content;
+        std::string_view content; // view into the mapped source, valid while the source is alive
         token_type type;
-        token* next;
+        opcode op;
         int line;
     } token;
 
-    bool is_string_literal(std::string& t);
-    bool is_type_specifier(std::string& t);
-    bool is_mnemonic(std::string& t);
-    bool is_numeric_literal(std::string& t);
-    int ends_with_punctuator(std::string& t);
-    void free_tokens(token* t);
+    bool is_string_literal(std::string_view t);
+    bool is_type_specifier(std::string_view t);
+    bool is_mnemonic(std::string_view t);
+    bool is_numeric_literal(std::string_view t);
+    bool is_punctuator(char c);
+    opcode punctuator(char c);
+    token_type classify(std::string_view t, opcode& op);
 }
 
 #endif
\ No newline at end of file